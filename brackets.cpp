@@ -0,0 +1,739 @@
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "brackets.h"
+#include "inputFile.h"
+#include "trace.h"
+#include "wordWrap.h"
+using namespace std;
+
+// Files smaller than this are not worth the cost of starting threads
+static const size_t PARALLEL_MIN_SIZE = 1 << 20;
+
+// Smallest share of a file given to one thread
+static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+// Approximate distance in bytes between checkpoints
+static const size_t CHECKPOINT_INTERVAL = 4096;
+
+// Line-start states a chunk can begin in: no quote, inside '...' or inside
+// "...", each with or without an open block comment. commentLine is always
+// false at the start of a line.
+static const int NUM_START_STATES = 6;
+
+struct BracketChunk {
+    const char *begin;
+    const char *end;
+    int lines;
+    int firstLine;
+    int startState;
+    int exitState[NUM_START_STATES];
+    BracketState state;
+    vector<BracketError> errors;
+    vector<BracketError> unmatched;
+};
+
+// The flags of a BracketState that findExitStates() lexes a chunk with, plus
+// the character a backslash told it to skip
+struct LexState {
+    bool singleQuote;
+    bool doubleQuote;
+    bool commentBlock;
+    bool commentLine;
+    const char *skip;
+};
+
+static void addError(vector<BracketError> &errors, int lineNumber,
+                     size_t column, BracketErrorKind kind, char symbol);
+static void describeError(ostream &os, const BracketError &error);
+static void reportSession(const string &filename, const BracketCheck &check,
+                          ostream &out);
+static void closeBracket(char opener, char closer, int lineNumber,
+                         size_t column, BracketState &state,
+                         vector<BracketError> &errors,
+                         vector<BracketError> *unmatched);
+static bool closeQuote(char quote, int lineNumber, size_t column,
+                       BracketState &state, vector<BracketError> &errors,
+                       vector<BracketError> *unmatched);
+static char openerFor(char closer);
+static void setStartState(int index, BracketState &state);
+static int startStateIndex(const BracketState &state);
+static size_t resumeBracketScan(const char *data, size_t length,
+                                const BracketCheckpoint &start,
+                                BracketCheck &check,
+                                const vector<BracketCheckpoint> *old,
+                                size_t oldEditEnd, size_t newEditEnd);
+static void addCheckpoint(BracketCheck &check, size_t offset, int line,
+                          const BracketState &state);
+static bool sameState(const BracketState &a, const BracketState &b);
+static void scanChunk(BracketChunk &chunk);
+static void findExitStates(BracketChunk &chunk);
+static void lexChar(const char *p, const char *end, LexState &state);
+
+void initBracketState(BracketState &state)
+{
+    state.stack.clear();
+    state.singleQuote = false;
+    state.doubleQuote = false;
+    state.commentBlock = false;
+    state.commentLine = false;
+}
+
+void scanBracketLine(const char *line, size_t length, int lineNumber,
+                     BracketState &state, vector<BracketError> &errors,
+                     vector<BracketError> *unmatched)
+{
+    char currentChar;
+    bool code;
+
+    for (size_t i = 0; i < length; i++) {
+        currentChar = line[i];
+        code = !state.singleQuote && !state.doubleQuote &&
+               !state.commentBlock && !state.commentLine;
+        switch (currentChar) {
+            case '{':
+            case '[':
+            case '(':
+                if (code) {
+                    state.stack.push_back(currentChar);
+                }
+                break;
+            case '}':
+            case ']':
+            case ')':
+                if (code) {
+                    closeBracket(openerFor(currentChar), currentChar,
+                                 lineNumber, i, state, errors, unmatched);
+                }
+                break;
+            case '\\':
+                if (!state.commentBlock && !state.commentLine) {
+                    i++;
+                }
+                break;
+            case '/':
+                if (i + 1 < length) {
+                    if (line[i + 1] == '/') {
+                        state.commentLine = true;
+                    } else if (line[i + 1] == '*') {
+                        state.commentBlock = true;
+                    }
+                }
+                break;
+            case '*':
+                if (!state.singleQuote && !state.doubleQuote &&
+                    i + 1 < length) {
+                    if (line[i + 1] == '/' && state.commentLine) {
+                        state.commentLine = false;
+                    } else if (line[i + 1] == '/' && !state.commentLine) {
+                        addError(errors, lineNumber, i, COMMENT_MISMATCH,
+                                 '*');
+                    }
+                }
+                break;
+            case '\'':
+                if (state.doubleQuote || state.commentBlock ||
+                    state.commentLine) {
+                    break;
+                } else if (state.singleQuote) {
+                    if (closeQuote(currentChar, lineNumber, i, state, errors,
+                                   unmatched)) {
+                        state.singleQuote = false;
+                    }
+                } else {
+                    state.stack.push_back(currentChar);
+                    state.singleQuote = true;
+                }
+                break;
+            case '\"':
+                if (state.singleQuote || state.commentBlock ||
+                    state.commentLine) {
+                    break;
+                } else if (state.doubleQuote) {
+                    if (closeQuote(currentChar, lineNumber, i, state, errors,
+                                   unmatched)) {
+                        state.doubleQuote = false;
+                    }
+                } else {
+                    state.stack.push_back(currentChar);
+                    state.doubleQuote = true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    state.commentLine = false;
+}
+
+void printBracketError(const string &filename, const BracketError &error)
+{
+    stringstream ss;
+
+    ss << filename << ':' << error.line;
+    describeError(ss, error);
+    wordWrap(ss, cerr, 0);
+}
+
+void checkBrackets(string filename)
+{
+    BracketState state;
+    vector<BracketError> errors;
+    InputFile infile(filename);
+    string currentLine;
+    int lineNumber = 1;
+
+    initBracketState(state);
+    while (!getline(infile, currentLine).eof()) {
+        scanBracketLine(currentLine.data(), currentLine.length(), lineNumber,
+                        state, errors, NULL);
+        for (size_t i = 0; i < errors.size(); i++) {
+            printBracketError(filename, errors[i]);
+        }
+        errors.clear();
+        lineNumber++;
+    }
+
+    infile.close();
+}
+
+void checkBracketText(const char *data, size_t length, BracketCheck &check)
+{
+    BracketCheckpoint start;
+
+    start.offset = 0;
+    start.line = 1;
+    initBracketState(start.state);
+    check.checkpoints.clear();
+    check.errors.clear();
+    resumeBracketScan(data, length, start, check, NULL, 0, 0);
+}
+
+void recheckBrackets(const char *data, size_t length, size_t editBegin,
+                     size_t oldEditEnd, size_t newEditEnd,
+                     BracketCheck &check)
+{
+    BracketCheck fresh;
+    vector<BracketCheckpoint> &old = check.checkpoints;
+    vector<BracketError> &errors = check.errors;
+    size_t k = 0, converged, i, firstError, lastError;
+    int lineShift = 0;
+
+    if (old.empty()) {
+        checkBracketText(data, length, check);
+        return;
+    }
+
+    while (k + 1 < old.size() && old[k + 1].offset <= editBegin) {
+        k++;
+    }
+    converged = resumeBracketScan(data, length, old[k], fresh, &old,
+                                  oldEditEnd, newEditEnd);
+
+    // Errors are in line order: replace those from the rescanned lines and
+    // shift the ones after them
+    firstError = 0;
+    while (firstError < errors.size() &&
+           errors[firstError].line < old[k].line) {
+        firstError++;
+    }
+    lastError = errors.size();
+    if (converged < old.size()) {
+        lineShift = fresh.checkpoints.back().line - old[converged].line;
+        fresh.checkpoints.pop_back();
+        lastError = firstError;
+        while (lastError < errors.size() &&
+               errors[lastError].line < old[converged].line) {
+            lastError++;
+        }
+        for (i = converged; i < old.size(); i++) {
+            old[i].offset = old[i].offset - oldEditEnd + newEditEnd;
+            old[i].line += lineShift;
+        }
+        for (i = lastError; i < errors.size(); i++) {
+            errors[i].line += lineShift;
+        }
+    }
+
+    old.erase(old.begin() + k, old.begin() + converged);
+    old.insert(old.begin() + k, fresh.checkpoints.begin(),
+               fresh.checkpoints.end());
+    errors.erase(errors.begin() + firstError, errors.begin() + lastError);
+    errors.insert(errors.begin() + firstError, fresh.errors.begin(),
+                  fresh.errors.end());
+}
+
+// The text is kept in memory, and each edit is spliced into it before the
+// check is updated
+int bracketEditSession(const string &filename, istream &in, ostream &out)
+{
+    ifstream infile(filename.c_str(), ios::binary);
+    stringstream contents;
+    BracketCheck check;
+    string text, command, replacement;
+    size_t begin, end, length;
+
+    if (!infile.is_open()) {
+        cerr << "Error opening file: " << filename << endl;
+        return 1;
+    }
+    contents << infile.rdbuf();
+    text = contents.str();
+
+    checkBracketText(text.data(), text.size(), check);
+    reportSession(filename, check, out);
+
+    while (in >> command) {
+        if (command != "edit" || !(in >> begin >> end >> length) ||
+            in.get() != '\n' || begin > end || end > text.size()) {
+            cerr << filename << ": bad edit command" << endl;
+            return 1;
+        }
+        replacement.resize(length);
+        if (length > 0 && !in.read(&replacement[0], length)) {
+            cerr << filename << ": edit ended early" << endl;
+            return 1;
+        }
+
+        text.replace(begin, end - begin, replacement);
+        recheckBrackets(text.data(), text.size(), begin, end,
+                        begin + length, check);
+        reportSession(filename, check, out);
+    }
+    return 0;
+}
+
+// Writes every mismatch as FILE:LINE:COLUMN message, then an empty line to
+// mark the end of the report
+static void reportSession(const string &filename, const BracketCheck &check,
+                          ostream &out)
+{
+    for (size_t i = 0; i < check.errors.size(); i++) {
+        out << filename << ':' << check.errors[i].line << ':'
+            << check.errors[i].column + 1;
+        describeError(out, check.errors[i]);
+        out << '\n';
+    }
+    out << endl;
+}
+
+/*
+ * Splits the file into one chunk of whole lines per job. While the first
+ * chunk is scanned, every other chunk is lexed from each possible start state
+ * to learn which state it leaves the scanner in; chaining those transitions
+ * gives every chunk its real start state. The rest are then scanned for real,
+ * each reducing to the closers it could not match plus the openers it left
+ * open, and the summaries are folded left to right so the output matches
+ * checkBrackets line for line.
+ */
+void checkBracketsParallel(string filename, unsigned jobs)
+{
+    TraceScope trace("checkBrackets", filename);
+    int fd;
+    struct stat info;
+    const char *data, *end, *cut;
+    size_t size, i;
+    unsigned k, cores;
+    int lineNumber, current;
+    vector<BracketChunk> chunks;
+    vector<thread> workers;
+    vector<char> stack;
+    vector<BracketError> errors;
+
+    fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) ||
+        (size_t)info.st_size < PARALLEL_MIN_SIZE) {
+        close(fd);
+        checkBrackets(filename);
+        return;
+    }
+
+    // Threads beyond the core count only add overhead, as do chunks too
+    // small to pay for starting a thread
+    cores = thread::hardware_concurrency();
+    if (cores > 0 && jobs > cores) {
+        jobs = cores;
+    }
+    if (jobs > (size_t)info.st_size / MIN_CHUNK_SIZE) {
+        jobs = info.st_size / MIN_CHUNK_SIZE;
+    }
+    if (jobs < 2) {
+        close(fd);
+        checkBrackets(filename);
+        return;
+    }
+
+    size = info.st_size;
+    {
+        TraceScope mapTrace("map", filename);
+        data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+    }
+    if (data == MAP_FAILED) {
+        checkBrackets(filename);
+        return;
+    }
+    if (detectCompression(data, size) != NO_COMPRESSION) {
+        munmap((void *)data, size);
+        checkBrackets(filename);
+        return;
+    }
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    // A trailing line without a newline is never checked by getline() either
+    end = (const char *)memrchr(data, '\n', size);
+    end = end ? end + 1 : data;
+
+    chunks.resize(jobs);
+    cut = data;
+    for (k = 0; k < jobs; k++) {
+        chunks[k].begin = cut;
+        if (k + 1 == jobs) {
+            cut = end;
+        } else if (cut < data + size * (k + 1) / jobs) {
+            cut = data + size * (k + 1) / jobs;
+            cut = cut < end ? (const char *)memchr(cut, '\n', end - cut) + 1
+                            : end;
+        }
+        chunks[k].end = cut;
+    }
+
+    // The first chunk starts in the initial state, so it is scanned for real
+    // while the others are lexed to find their exit states
+    chunks[0].firstLine = 1;
+    chunks[0].startState = 0;
+    workers.push_back(thread(scanChunk, ref(chunks[0])));
+    for (k = 1; k < jobs; k++) {
+        workers.push_back(thread(findExitStates, ref(chunks[k])));
+    }
+    for (k = 0; k < jobs; k++) {
+        workers[k].join();
+    }
+    workers.clear();
+
+    lineNumber = 1 + chunks[0].lines;
+    current = startStateIndex(chunks[0].state);
+    for (k = 1; k < jobs; k++) {
+        chunks[k].firstLine = lineNumber;
+        chunks[k].startState = current;
+        lineNumber += chunks[k].lines;
+        current = chunks[k].exitState[current];
+    }
+
+    for (k = 1; k < jobs; k++) {
+        workers.push_back(thread(scanChunk, ref(chunks[k])));
+    }
+    for (k = 0; k + 1 < jobs; k++) {
+        workers[k].join();
+    }
+    munmap((void *)data, size);
+
+    for (k = 0; k < jobs; k++) {
+        for (i = 0; i < chunks[k].unmatched.size(); i++) {
+            const BracketError &closer = chunks[k].unmatched[i];
+            if (!stack.empty() && stack.back() == openerFor(closer.symbol)) {
+                stack.pop_back();
+            } else {
+                errors.push_back(closer);
+            }
+        }
+        errors.insert(errors.end(), chunks[k].errors.begin(),
+                      chunks[k].errors.end());
+        stack.insert(stack.end(), chunks[k].state.stack.begin(),
+                     chunks[k].state.stack.end());
+    }
+
+    stable_sort(errors.begin(), errors.end(),
+                [](const BracketError &a, const BracketError &b) {
+                    return a.line < b.line ||
+                           (a.line == b.line && a.column < b.column);
+                });
+    for (i = 0; i < errors.size(); i++) {
+        printBracketError(filename, errors[i]);
+    }
+}
+
+/*
+ * Scans whole lines from start, adding checkpoints and errors to check. When
+ * the checkpoints of an earlier check are given, the lines after the edit
+ * are checkpointed where the earlier check had them, and scanning stops at
+ * the first of those whose state is unchanged. That checkpoint is added last
+ * and its index returned; if there is none, old->size() is returned.
+ */
+static size_t resumeBracketScan(const char *data, size_t length,
+                                const BracketCheckpoint &start,
+                                BracketCheck &check,
+                                const vector<BracketCheckpoint> *old,
+                                size_t oldEditEnd, size_t newEditEnd)
+{
+    BracketState state = start.state;
+    size_t offset = start.offset;
+    size_t lastCheckpoint = offset;
+    size_t k = 0, moved = 0;
+    int lineNumber = start.line;
+    const char *newline;
+
+    if (old) {
+        while (k < old->size() && (*old)[k].offset <= oldEditEnd) {
+            k++;
+        }
+    }
+
+    addCheckpoint(check, offset, lineNumber, state);
+    while (offset < length) {
+        newline = (const char *)memchr(data + offset, '\n', length - offset);
+        if (!newline) {
+            break;
+        }
+        scanBracketLine(data + offset, newline - data - offset, lineNumber,
+                        state, check.errors, NULL);
+        offset = newline - data + 1;
+        lineNumber++;
+
+        if (old && k < old->size()) {
+            moved = (*old)[k].offset - oldEditEnd + newEditEnd;
+            while (moved < offset && ++k < old->size()) {
+                moved = (*old)[k].offset - oldEditEnd + newEditEnd;
+            }
+        }
+        if (old && k < old->size() && moved == offset) {
+            addCheckpoint(check, offset, lineNumber, state);
+            lastCheckpoint = offset;
+            if (sameState((*old)[k].state, state)) {
+                return k;
+            }
+        } else if (old && k < old->size() && offset > newEditEnd) {
+            continue;
+        } else if (offset - lastCheckpoint >= CHECKPOINT_INTERVAL) {
+            addCheckpoint(check, offset, lineNumber, state);
+            lastCheckpoint = offset;
+        }
+    }
+
+    return old ? old->size() : 0;
+}
+
+static void addCheckpoint(BracketCheck &check, size_t offset, int line,
+                          const BracketState &state)
+{
+    BracketCheckpoint checkpoint;
+
+    checkpoint.offset = offset;
+    checkpoint.line = line;
+    checkpoint.state = state;
+    check.checkpoints.push_back(checkpoint);
+}
+
+static bool sameState(const BracketState &a, const BracketState &b)
+{
+    return a.singleQuote == b.singleQuote && a.doubleQuote == b.doubleQuote &&
+           a.commentBlock == b.commentBlock && a.stack == b.stack;
+}
+
+static void describeError(ostream &os, const BracketError &error)
+{
+    if (error.kind == COMMENT_MISMATCH) {
+        os << " Comment mismatch '*/'";
+    } else if (error.kind == QUOTE_MISMATCH) {
+        os << " Quotation mismatch \'" << error.symbol << "\'";
+    } else {
+        os << " Bracket mismatch \'" << error.symbol << "\'";
+    }
+}
+
+static void addError(vector<BracketError> &errors, int lineNumber,
+                     size_t column, BracketErrorKind kind, char symbol)
+{
+    BracketError error = {lineNumber, column, kind, symbol};
+    errors.push_back(error);
+}
+
+static void closeBracket(char opener, char closer, int lineNumber,
+                         size_t column, BracketState &state,
+                         vector<BracketError> &errors,
+                         vector<BracketError> *unmatched)
+{
+    if (state.stack.empty() && unmatched) {
+        addError(*unmatched, lineNumber, column, BRACKET_MISMATCH, closer);
+    } else if (state.stack.empty() || state.stack.back() != opener) {
+        addError(errors, lineNumber, column, BRACKET_MISMATCH, closer);
+    } else {
+        state.stack.pop_back();
+    }
+}
+
+// Returns true if the quote was closed. With a deferred stack the opening
+// quote is assumed to be on the stack that comes before, which always holds
+// as nothing is pushed while a quote is open.
+static bool closeQuote(char quote, int lineNumber, size_t column,
+                       BracketState &state, vector<BracketError> &errors,
+                       vector<BracketError> *unmatched)
+{
+    if (state.stack.empty() && unmatched) {
+        addError(*unmatched, lineNumber, column, QUOTE_MISMATCH, quote);
+    } else if (state.stack.empty() || state.stack.back() != quote) {
+        addError(errors, lineNumber, column, QUOTE_MISMATCH, quote);
+        return false;
+    } else {
+        state.stack.pop_back();
+    }
+    return true;
+}
+
+static char openerFor(char closer)
+{
+    switch (closer) {
+        case '}':
+            return '{';
+        case ']':
+            return '[';
+        case ')':
+            return '(';
+        default:
+            return closer;
+    }
+}
+
+static void setStartState(int index, BracketState &state)
+{
+    initBracketState(state);
+    state.singleQuote = index % 3 == 1;
+    state.doubleQuote = index % 3 == 2;
+    state.commentBlock = index / 3 == 1;
+}
+
+static int startStateIndex(const BracketState &state)
+{
+    int index = state.commentBlock ? 3 : 0;
+
+    if (state.singleQuote) {
+        index += 1;
+    } else if (state.doubleQuote) {
+        index += 2;
+    }
+    return index;
+}
+
+static void scanChunk(BracketChunk &chunk)
+{
+    TraceScope trace("scanChunk");
+    const char *line = chunk.begin;
+    const char *newline;
+    int lineNumber = chunk.firstLine;
+
+    setStartState(chunk.startState, chunk.state);
+    while (line < chunk.end) {
+        newline = (const char *)memchr(line, '\n', chunk.end - line);
+        scanBracketLine(line, newline - line, lineNumber, chunk.state,
+                        chunk.errors, &chunk.unmatched);
+        line = newline + 1;
+        lineNumber++;
+    }
+    chunk.lines = lineNumber - chunk.firstLine;
+}
+
+/*
+ * Finds the state each line-start state leaves the chunk in. Only the quote
+ * and comment flags decide how later characters are read, so they are all
+ * the lexer tracks: no stack is kept and no errors are collected. Once a
+ * block comment opens nothing can close it or change the quote flags, so
+ * the three states inside one are their own exit states and only the other
+ * three are lexed, side by side in a single pass over the chunk.
+ */
+static void findExitStates(BracketChunk &chunk)
+{
+    TraceScope trace("findExitStates");
+    LexState states[NUM_START_STATES / 2];
+    const char *p;
+    int s;
+
+    for (s = 0; s < NUM_START_STATES / 2; s++) {
+        states[s].singleQuote = s == 1;
+        states[s].doubleQuote = s == 2;
+        states[s].commentBlock = false;
+        states[s].commentLine = false;
+        states[s].skip = NULL;
+    }
+
+    chunk.lines = 0;
+    for (p = chunk.begin; p < chunk.end; p++) {
+        switch (*p) {
+            case '\n':
+                chunk.lines++;
+                for (s = 0; s < NUM_START_STATES / 2; s++) {
+                    states[s].commentLine = false;
+                }
+                break;
+            case '\\':
+            case '/':
+            case '*':
+            case '\'':
+            case '\"':
+                for (s = 0; s < NUM_START_STATES / 2; s++) {
+                    lexChar(p, chunk.end, states[s]);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    for (s = 0; s < NUM_START_STATES / 2; s++) {
+        chunk.exitState[s] = (states[s].commentBlock ? 3 : 0) +
+                             (states[s].singleQuote ? 1 : 0) +
+                             (states[s].doubleQuote ? 2 : 0);
+        chunk.exitState[s + NUM_START_STATES / 2] = s + NUM_START_STATES / 2;
+    }
+}
+
+// Applies one character to a state the way scanBracketLine() does. A quote
+// always closes: the stack can only be missing its opening quote if the
+// quote was opened before the chunk, and then the closer is deferred.
+static void lexChar(const char *p, const char *end, LexState &state)
+{
+    if (p == state.skip) {
+        return;
+    }
+    switch (*p) {
+        case '\\':
+            if (!state.commentBlock && !state.commentLine) {
+                state.skip = p + 1;
+            }
+            break;
+        case '/':
+            if (p + 1 < end && p[1] == '/') {
+                state.commentLine = true;
+            } else if (p + 1 < end && p[1] == '*') {
+                state.commentBlock = true;
+            }
+            break;
+        case '*':
+            if (!state.singleQuote && !state.doubleQuote && p + 1 < end &&
+                p[1] == '/' && state.commentLine) {
+                state.commentLine = false;
+            }
+            break;
+        case '\'':
+            if (!state.doubleQuote && !state.commentBlock &&
+                !state.commentLine) {
+                state.singleQuote = !state.singleQuote;
+            }
+            break;
+        case '\"':
+            if (!state.singleQuote && !state.commentBlock &&
+                !state.commentLine) {
+                state.doubleQuote = !state.doubleQuote;
+            }
+            break;
+        default:
+            break;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef BRACKETS_H
+#define BRACKETS_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+enum BracketErrorKind {
+    BRACKET_MISMATCH,
+    QUOTE_MISMATCH,
+    COMMENT_MISMATCH
+};
+
+struct BracketError {
+    int line;
+    size_t column;
+    BracketErrorKind kind;
+    char symbol;
+};
+
+// Everything the bracket scanner carries from one line to the next. The
+// stack holds open brackets and quotes, innermost last.
+struct BracketState {
+    std::vector<char> stack;
+    bool singleQuote;
+    bool doubleQuote;
+    bool commentBlock;
+    bool commentLine;
+};
+
+// The scanner state at the start of a line, from which scanning can resume
+struct BracketCheckpoint {
+    size_t offset;
+    int line;
+    BracketState state;
+};
+
+// The result of checking a whole text, kept so that it can be updated after
+// an edit without scanning the text again
+struct BracketCheck {
+    std::vector<BracketCheckpoint> checkpoints;
+    std::vector<BracketError> errors;
+};
+
+void initBracketState(BracketState &state);
+
+// Scans one line (without its newline). Mismatches are appended to errors.
+// If unmatched is not NULL, closers that find the stack empty are appended
+// to it instead of being reported, so that they can be resolved later
+// against the state left by the text that comes before.
+void scanBracketLine(const char *line, size_t length, int lineNumber,
+                     BracketState &state, std::vector<BracketError> &errors,
+                     std::vector<BracketError> *unmatched);
+void printBracketError(const std::string &filename, const BracketError &error);
+
+// Checks the contents of a file, recording a checkpoint every few KB
+void checkBracketText(const char *data, size_t length, BracketCheck &check);
+
+// Updates check after the bytes [editBegin, oldEditEnd) of the text it was
+// made from were replaced, so that they now span [editBegin, newEditEnd) of
+// data. Scanning resumes from the last checkpoint before the edit and stops
+// at the first checkpoint after it whose state is unchanged, so the cost
+// depends on the size of the edit rather than the size of the text.
+void recheckBrackets(const char *data, size_t length, size_t editBegin,
+                     size_t oldEditEnd, size_t newEditEnd,
+                     BracketCheck &check);
+
+// Keeps the brackets of a file checked while an editor changes it, using
+// recheckBrackets(). Edits are read from in as "edit BEGIN END LENGTH", a
+// newline and LENGTH bytes replacing [BEGIN, END). The mismatches are
+// written to out at the start and after every edit, one per line as
+// FILE:LINE:COLUMN message and ending with an empty line. Returns the exit
+// status.
+int bracketEditSession(const std::string &filename, std::istream &in,
+                       std::ostream &out);
+
+void checkBrackets(std::string filename);
+void checkBracketsParallel(std::string filename, unsigned jobs);
+
+#endif
@@ -0,0 +1,51 @@
+#include <vector>
+#include "brackets.h"
+#include "checkStream.h"
+#include "trace.h"
+#include "wordWrap.h"
+using namespace std;
+
+void checkStream(const string &name, istream &in, const StreamChecks &checks)
+{
+    TraceScope trace("checkStream", name);
+    BracketState state;
+    vector<BracketError> errors;
+    string checkLine;
+    stringstream ss;
+    unsigned lineNumber = 1, longLines = 0;
+    bool tabs = checks.tabs;
+    bool columns = checks.columns;
+
+    initBracketState(state);
+    // A read error leaves the stream failed without reaching end of file
+    while (getline(in, checkLine) && !in.eof()) {
+        if (tabs && checkLine.find('\t') != string::npos) {
+            ss << "Tabs found in " << name << ":" << lineNumber;
+            wordWrap(ss, cerr, 0);
+            tabs = false;
+        }
+
+        if (columns && checkLine.length() > 80) {
+            if (longLines < 4) {
+                cout << name << ":" << lineNumber
+                     << " goes past 80 columns." << endl;
+                longLines++;
+            } else {
+                cout << "More than 4 lines go past 80 columns in \'"
+                     << name << "\'..." << endl;
+                columns = false;
+            }
+        }
+
+        if (checks.brackets) {
+            scanBracketLine(checkLine.data(), checkLine.length(), lineNumber,
+                            state, errors, NULL);
+            for (size_t i = 0; i < errors.size(); i++) {
+                printBracketError(name, errors[i]);
+            }
+            errors.clear();
+        }
+
+        lineNumber++;
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef CHECK_STREAM_H
+#define CHECK_STREAM_H
+
+#include <istream>
+#include <string>
+
+struct StreamChecks {
+    bool tabs;
+    bool columns;
+    bool brackets;
+};
+
+// Runs every enabled check over the stream in a single pass, for input that
+// can only be read once. Tabs are reported but never offered for detabbing.
+void checkStream(const std::string &name, std::istream &in,
+                 const StreamChecks &checks);
+
+#endif
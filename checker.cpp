@@ -1,9 +1,24 @@
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <cerrno>
 #include <cstdlib>
 #include <vector>
-#include <stack>
+#include <cstring>
+#include <set>
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "brackets.h"
+#include "checkStream.h"
+#include "detab.h"
+#include "inputFile.h"
+#include "schedule.h"
+#include "shard.h"
+#include "tarArchive.h"
+#include "trace.h"
 #include "wordWrap.h"
 using namespace std;
 
@@ -13,50 +28,305 @@ struct Flags {
     bool brackets;
     bool readHidden;
     bool recursive;
+    unsigned jobs;
+    unsigned shardIndex;
+    unsigned shardCount;
+    bool merge;
+    ScheduleOrder schedule;
+    unsigned bench;
+    string trace;
+    string stdinName;
+    string filesFrom;
+    string editSession;
 };
 
+typedef pair<dev_t, ino_t> FileId;
+
+// What readdir() says about an entry, kept so entries can be sorted by name
+struct DirEntry {
+    string name;
+    unsigned char type;
+    ino_t inode;
+};
+
+// Number of files to prefetch ahead of the one being checked
+static const size_t PREFETCH_WINDOW = 8;
+
 void printHelp(char **argv);
 vector<string> parseArguments(int argc, char **argv, Flags &cFlags);
 void addFile(string path, vector<string> &files, bool recursive, 
-             bool readHidden);
-void checkColumns(vector<string> files);
-void checkTabs(vector<string> files);
+             bool readHidden, set<FileId> &seen);
+static void addDirectory(int fd, dev_t device, const string &path,
+                         vector<string> &files, bool readHidden,
+                         set<FileId> &seen);
+void addFileList(const string &listName, vector<string> &files,
+                 bool recursive, bool readHidden, set<FileId> &seen);
+static bool singlePass(const string &path);
+void runChecks(const vector<string> &paths, const vector<size_t> &order,
+               const Flags &cFlags, ShardCapture &capture);
+void benchmark(const vector<string> &paths, const vector<size_t> &files,
+               Flags cFlags, ShardCapture &capture);
+void checkColumns(string filename, InputFile &infile);
+void checkTabs(string filename, InputFile &infile);
 void detab(string filename);
-void checkBrackets(string filename);
 
 int main(int argc, char **argv) 
 {
-    unsigned i;
-    Flags cFlags = {false, false, false, false, false};
-    vector<string> files = parseArguments(argc, argv, cFlags);
+    size_t i;
+    Flags cFlags = {false, false, false, false, false, 1, 0, 0, false,
+                    TRAVERSAL_ORDER, 0, "", "<stdin>", "", ""};
+    vector<string> args = parseArguments(argc, argv, cFlags);
+    vector<string> paths;
+    vector<unsigned> shards;
+    vector<size_t> order;
+    set<FileId> seen;
+    bool readsStdin;
+
+    if (!cFlags.editSession.empty()) {
+        return bracketEditSession(cFlags.editSession, cin, cout);
+    }
+
+    if (args.empty() && cFlags.filesFrom.empty()) {
+        printHelp(argv);
+    }
+
+    if (cFlags.merge) {
+        return mergeReports(args);
+    }
+
+    ShardCapture capture(cFlags.shardCount > 0);
+
+    if (!cFlags.trace.empty()) {
+        startTrace();
+    }
 
-    if (files.empty()) {
+    capture.begin();
+    for (i = 0; i < args.size(); i++) {
+        addFile(args[i], paths, cFlags.recursive, cFlags.readHidden, seen);
+    }
+    if (!cFlags.filesFrom.empty()) {
+        addFileList(cFlags.filesFrom, paths, cFlags.recursive,
+                    cFlags.readHidden, seen);
+    }
+    if (cFlags.shardIndex == 0) {
+        capture.end(TRAVERSAL_PHASE, 0);
+    } else {
+        capture.discard();
+    }
+
+    readsStdin = find(paths.begin(), paths.end(), "-") != paths.end();
+    if (readsStdin && cFlags.filesFrom == "-") {
+        cerr << argv[0] << ": standard input cannot be both checked and read "
+             << "as the file list" << endl;
+        return 1;
+    }
+    // The detab prompt is turned off when standard input holds data rather
+    // than answers, and when sharding, where it would be captured into the
+    // report while the process waits for an answer
+    if (readsStdin || cFlags.filesFrom == "-" || cFlags.shardCount > 0) {
+        cin.setstate(ios::failbit);
+    }
+
+    if (paths.empty()) {
         printHelp(argv);
     }
 
-    if (cFlags.tabs){
-        checkTabs(files);
+    if (cFlags.shardCount > 0) {
+        shards = assignShards(paths, cFlags.shardCount);
+    } else {
+        shards.assign(paths.size(), 0);
+    }
+    for (i = 0; i < paths.size(); i++) {
+        if (shards[i] == cFlags.shardIndex) {
+            order.push_back(i);
+        }
+    }
+
+    if (cFlags.bench > 0) {
+        benchmark(paths, order, cFlags, capture);
+    } else {
+        scheduleFiles(paths, order, cFlags.schedule);
+        runChecks(paths, order, cFlags, capture);
+    }
+
+    if (!cFlags.trace.empty() && !writeTrace(cFlags.trace)) {
+        cerr << "Error writing trace: " << cFlags.trace << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Runs every enabled check over the files in order. With a disk schedule,
+ * the next few files are prefetched while the current one is checked.
+ */
+void runChecks(const vector<string> &paths, const vector<size_t> &order,
+               const Flags &cFlags, ShardCapture &capture)
+{
+    size_t i, n;
+    StreamChecks checks = {cFlags.tabs, cFlags.columns, cFlags.brackets};
+    Prefetcher prefetch(paths, order, cFlags.schedule == TRAVERSAL_ORDER ?
+                                      0 : PREFETCH_WINDOW);
+    // Compressed files are found when first opened, and then checked in one
+    // pass rather than decompressed again for every phase
+    vector<bool> checked(paths.size(), false);
+
+    if (cFlags.tabs) {
+        prefetch.restart();
+        for (n = 0; n < order.size(); n++) {
+            i = order[n];
+            if (!singlePass(paths[i])) {
+                InputFile infile(paths[i]);
+
+                prefetch.advance(n);
+                capture.begin();
+                if (infile.compressed()) {
+                    checkStream(paths[i], infile, checks);
+                    checked[i] = true;
+                } else {
+                    checkTabs(paths[i], infile);
+                }
+                capture.end(TABS_PHASE, i);
+            }
+        }
     }
 
     if (cFlags.columns) {
-        checkColumns(files);
+        prefetch.restart();
+        for (n = 0; n < order.size(); n++) {
+            i = order[n];
+            if (!singlePass(paths[i]) && !checked[i]) {
+                InputFile infile(paths[i]);
+
+                prefetch.advance(n);
+                capture.begin();
+                if (infile.compressed()) {
+                    checkStream(paths[i], infile, checks);
+                    checked[i] = true;
+                } else {
+                    checkColumns(paths[i], infile);
+                }
+                capture.end(COLUMNS_PHASE, i);
+            }
+        }
     }
 
     if (cFlags.brackets) {
-        for (i = 0; i < files.size(); i++) {
-            checkBrackets(files[i]);
+        prefetch.restart();
+        for (n = 0; n < order.size(); n++) {
+            i = order[n];
+            if (!singlePass(paths[i]) && !checked[i]) {
+                prefetch.advance(n);
+                capture.begin();
+                checkBracketsParallel(paths[i], cFlags.jobs);
+                capture.end(BRACKETS_PHASE, i);
+            }
         }
     }
 
-    return 0;
+    prefetch.restart();
+    for (n = 0; n < order.size(); n++) {
+        i = order[n];
+        if (paths[i] == "-") {
+            InputFile in;
+
+            capture.begin();
+            in.open(STDIN_FILENO, cFlags.stdinName);
+            if (in.is_open()) {
+                checkStream(cFlags.stdinName, in, checks);
+            } else {
+                cerr << "Error reading standard input" << endl;
+            }
+            capture.end(ARCHIVE_PHASE, i);
+        } else if (isTarArchive(paths[i])) {
+            prefetch.advance(n);
+            capture.begin();
+            checkTarArchive(paths[i], checks);
+            capture.end(ARCHIVE_PHASE, i);
+        }
+    }
+}
+
+// Standard input and archives can only be read once, so every check is run
+// over them together in a single pass
+static bool singlePass(const string &path)
+{
+    return path == "-" || isTarArchive(path);
+}
+
+/*
+ * Times cold-cache runs in traversal order against runs in the requested
+ * schedule (extent order if none was given), dropping the page cache before
+ * each one. Diagnostics are discarded and the detab prompt is declined.
+ */
+void benchmark(const vector<string> &paths, const vector<size_t> &files,
+               Flags cFlags, ShardCapture &capture)
+{
+    ScheduleOrder schedules[2] = {TRAVERSAL_ORDER, cFlags.schedule};
+    double total[2] = {0, 0};
+    vector<size_t> order;
+    chrono::steady_clock::time_point start;
+    chrono::duration<double> elapsed;
+    ofstream devNull("/dev/null");
+    streambuf *realOut, *realErr;
+    bool fullDrop = true;
+    unsigned round;
+    int k;
+
+    if (schedules[1] == TRAVERSAL_ORDER) {
+        schedules[1] = EXTENT_ORDER;
+    }
+    cin.setstate(ios::failbit);
+
+    for (round = 1; round <= cFlags.bench; round++) {
+        for (k = 0; k < 2; k++) {
+            fullDrop = dropCaches(paths) && fullDrop;
+
+            start = chrono::steady_clock::now();
+            realOut = cout.rdbuf(devNull.rdbuf());
+            realErr = cerr.rdbuf(devNull.rdbuf());
+            order = files;
+            cFlags.schedule = schedules[k];
+            scheduleFiles(paths, order, cFlags.schedule);
+            runChecks(paths, order, cFlags, capture);
+            cout.rdbuf(realOut);
+            cerr.rdbuf(realErr);
+            elapsed = chrono::steady_clock::now() - start;
+
+            total[k] += elapsed.count();
+            cerr << "round " << round << ", " << scheduleName(schedules[k])
+                 << " order: " << elapsed.count() << "s" << endl;
+        }
+    }
+
+    for (k = 0; k < 2; k++) {
+        cerr << "mean " << scheduleName(schedules[k]) << " order: "
+             << total[k] / cFlags.bench << "s" << endl;
+    }
+    if (!fullDrop) {
+        cerr << "note: could not drop the page cache, so only the checked "
+             << "files were evicted between runs" << endl;
+    }
 }
 
 void printHelp(char **argv)
 {
     stringstream ss;
     ss << "usage: " << argv[0] << " [-abcrt] [--all] [--bracket] "
-       << "[--column] [--tab] [--recursive] [file ...]";
+       << "[--column] [--tab] [--recursive] [--jobs=N] [--shard=i/N] "
+       << "[--schedule=ORDER] [--bench=N] [--trace=FILE] "
+       << "[--stdin-filename=NAME] [--files-from=LIST] [file ...]";
+    wordWrap(ss, cerr, 0);
+    ss << "usage: " << argv[0] << " --merge [report ...]";
+    wordWrap(ss, cerr, 0);
+    ss << "usage: " << argv[0] << " --edit-session=FILE";
     wordWrap(ss, cerr, 0);
+    ss << "A file named - is read from standard input, which turns off the "
+       << "detab prompt. Files may be gzip or "
+       << "zstd compressed. Tar archives (.tar, .tar.gz, .tgz, .tar.zst) are "
+       << "checked member by member without being extracted.";
+    wordWrap(ss, cerr, 4);
 
     ss << "-a, --all";
     wordWrap(ss, cerr, 4);
@@ -76,6 +346,15 @@ void printHelp(char **argv)
     wordWrap(ss, cerr, 8);
     cerr << endl;
 
+    ss << "--bench=N";
+    wordWrap(ss, cerr, 4);
+
+    ss << "Instead of printing diagnostics, time N rounds of checking in "
+       << "the order files were found and in the --schedule order, dropping "
+       << "the page cache before each run.";
+    wordWrap(ss, cerr, 8);
+    cerr << endl;
+
     ss << "-c, --column";
     wordWrap(ss, cerr, 4); 
 
@@ -84,6 +363,44 @@ void printHelp(char **argv)
     wordWrap(ss, cerr, 8);
     cerr << endl;
 
+    ss << "--edit-session=FILE";
+    wordWrap(ss, cerr, 4);
+
+    ss << "Check the brackets of FILE, then keep them checked as an editor "
+       << "changes it, rechecking only as much as each edit affects. Each "
+       << "edit is read from standard input as a line 'edit BEGIN END LENGTH' "
+       << "followed by LENGTH bytes that replace bytes BEGIN to END of the "
+       << "text. After loading and after each edit, the mismatches are "
+       << "printed as FILE:LINE:COLUMN lines, followed by an empty line.";
+    wordWrap(ss, cerr, 8);
+    cerr << endl;
+
+    ss << "--files-from=LIST";
+    wordWrap(ss, cerr, 4);
+
+    ss << "Also check the paths in LIST, separated by NUL characters, as "
+       << "written by find -print0 or git ls-files -z. If LIST is -, the "
+       << "paths are read from standard input.";
+    wordWrap(ss, cerr, 8);
+    cerr << endl;
+
+    ss << "--jobs=N";
+    wordWrap(ss, cerr, 4);
+
+    ss << "Check the brackets of large files using N threads, at most one per "
+       << "core and per 256 KB of the file. The results are the same as when "
+       << "checking with a single thread.";
+    wordWrap(ss, cerr, 8);
+    cerr << endl;
+
+    ss << "--merge";
+    wordWrap(ss, cerr, 4);
+
+    ss << "Combine the reports written by --shard into the output of a "
+       << "single unsharded run.";
+    wordWrap(ss, cerr, 8);
+    cerr << endl;
+
     ss << "-r, --recursive";
     wordWrap(ss, cerr, 4); 
 
@@ -92,6 +409,42 @@ void printHelp(char **argv)
     wordWrap(ss, cerr, 8);
     cerr << endl;
 
+    ss << "--schedule=ORDER";
+    wordWrap(ss, cerr, 4);
+
+    ss << "Check files in the order they are stored on disk rather than the "
+       << "order they were found, and read ahead of the file being checked. "
+       << "ORDER is 'inode', or 'extent' to use the physical location where "
+       << "the file system reports it. Diagnostics follow the same order.";
+    wordWrap(ss, cerr, 8);
+    cerr << endl;
+
+    ss << "--shard=i/N";
+    wordWrap(ss, cerr, 4);
+
+    ss << "Only check shard i (counting from 0) of N, with files split so "
+       << "each shard holds about the same amount of data. The results are "
+       << "written to stdout as a report for --merge. Files with tabs are "
+       << "reported but not offered for detab.";
+    wordWrap(ss, cerr, 8);
+    cerr << endl;
+
+    ss << "--trace=FILE";
+    wordWrap(ss, cerr, 4);
+
+    ss << "Record when each directory is read, each file is opened and read, "
+       << "and each check runs, on every thread, and write the timeline to "
+       << "FILE in Chrome trace-event format.";
+    wordWrap(ss, cerr, 8);
+    cerr << endl;
+
+    ss << "--stdin-filename=NAME";
+    wordWrap(ss, cerr, 4);
+
+    ss << "Use NAME for standard input in diagnostics.";
+    wordWrap(ss, cerr, 8);
+    cerr << endl;
+
     ss << "-t, --tab";
     wordWrap(ss, cerr, 4); 
 
@@ -104,7 +457,6 @@ void printHelp(char **argv)
 
 vector<string> parseArguments(int argc, char **argv, Flags &cFlags)
 {
-    vector<string> files;
     int i;
     unsigned j;
     vector<string> paths;
@@ -112,14 +464,8 @@ vector<string> parseArguments(int argc, char **argv, Flags &cFlags)
     stringstream ss;
 
     for (i = 1; i < argc; i++) {
-        if (argv[i][0] == '-') {
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
             currentArg = argv[i];
-            if (currentArg.size() == 1) {
-                ss << argv[0] << ": unregonized flag \'" << argv[i]
-                   << "\'";
-                wordWrap(ss, cerr, 0);
-                printHelp(argv);
-            }
             if (currentArg.substr(1, currentArg.length() - 1) == "-all") {
                 cFlags.readHidden = true;
                 continue;
@@ -139,6 +485,56 @@ vector<string> parseArguments(int argc, char **argv, Flags &cFlags)
                        "-tab") {
                 cFlags.tabs = true;
                 continue;
+            } else if (currentArg.compare(0, 7, "--jobs=") == 0) {
+                if (atoi(currentArg.c_str() + 7) < 1) {
+                    ss << argv[0] << ": invalid job count '"
+                       << currentArg.substr(7) << "'";
+                    wordWrap(ss, cerr, 0);
+                    printHelp(argv);
+                }
+                cFlags.jobs = atoi(currentArg.c_str() + 7);
+                continue;
+            } else if (currentArg.compare(0, 8, "--shard=") == 0) {
+                if (!parseShard(currentArg.substr(8), cFlags.shardIndex,
+                                cFlags.shardCount)) {
+                    ss << argv[0] << ": invalid shard '"
+                       << currentArg.substr(8) << "'";
+                    wordWrap(ss, cerr, 0);
+                    printHelp(argv);
+                }
+                continue;
+            } else if (currentArg.compare(0, 11, "--schedule=") == 0) {
+                if (!parseSchedule(currentArg.substr(11), cFlags.schedule)) {
+                    ss << argv[0] << ": unknown schedule \'"
+                       << currentArg.substr(11) << "\'";
+                    wordWrap(ss, cerr, 0);
+                    printHelp(argv);
+                }
+                continue;
+            } else if (currentArg.compare(0, 8, "--bench=") == 0) {
+                if (atoi(currentArg.c_str() + 8) < 1) {
+                    ss << argv[0] << ": invalid round count \'"
+                       << currentArg.substr(8) << "\'";
+                    wordWrap(ss, cerr, 0);
+                    printHelp(argv);
+                }
+                cFlags.bench = atoi(currentArg.c_str() + 8);
+                continue;
+            } else if (currentArg.compare(0, 8, "--trace=") == 0) {
+                cFlags.trace = currentArg.substr(8);
+                continue;
+            } else if (currentArg.compare(0, 17, "--stdin-filename=") == 0) {
+                cFlags.stdinName = currentArg.substr(17);
+                continue;
+            } else if (currentArg.compare(0, 13, "--files-from=") == 0) {
+                cFlags.filesFrom = currentArg.substr(13);
+                continue;
+            } else if (currentArg.compare(0, 15, "--edit-session=") == 0) {
+                cFlags.editSession = currentArg.substr(15);
+                continue;
+            } else if (currentArg == "--merge") {
+                cFlags.merge = true;
+                continue;
             }
             for (j = 1; j < strlen(argv[i]); j++) {
                 if (argv[i][j] == 'a') {
@@ -164,329 +560,246 @@ vector<string> parseArguments(int argc, char **argv, Flags &cFlags)
         paths.push_back(argv[i]);
     }
 
-    for (i = 0; (size_t)i < paths.size(); i++) {
-        addFile(paths[i], files, cFlags.recursive, cFlags.readHidden);
-    }
-
-    return files;
+    return paths;
 }
 
 void addFile(string path, vector<string> &files, bool recursive, 
-             bool readHidden) 
+             bool readHidden, set<FileId> &seen) 
 {
-    struct dirent *entry;
-    DIR *dp = opendir(path.c_str());
-    string newPath;
-    string currentEntry;
+    struct stat info;
+    int fd;
 
-    if (!dp) {
+    if (path == "-") {
+        files.push_back(path);
+        return;
+    }
+
+    if (stat(path.c_str(), &info) != 0) {
         files.push_back(path);
         return;
     }
 
+    if (!S_ISDIR(info.st_mode)) {
+        if (seen.insert(FileId(info.st_dev, info.st_ino)).second) {
+            files.push_back(path);
+        }
+        return;
+    }
+
     if (!recursive) {
         cerr << path << " is a directory" << endl;
-        closedir(dp);
         return;
     }
 
-    entry = readdir(dp);
-    while (entry) {
-        currentEntry = entry->d_name;
-        
-        if (currentEntry == "." || currentEntry == "..") {
-            entry = readdir(dp);
+    fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        files.push_back(path);
+        return;
+    }
+    if (seen.insert(FileId(info.st_dev, info.st_ino)).second) {
+        addDirectory(fd, info.st_dev, path, files, readHidden, seen);
+    } else {
+        close(fd);
+    }
+}
+
+/*
+ * Walks an open directory, taking ownership of fd. Entries are classified
+ * from d_type, with fstatat() only for symlinks and file systems that do not
+ * report a type, and subdirectories are opened relative to their parent.
+ * Every file and directory is identified by (device, inode) so hard links
+ * are only checked once and symlink loops end.
+ */
+static void addDirectory(int fd, dev_t device, const string &path,
+                         vector<string> &files, bool readHidden,
+                         set<FileId> &seen)
+{
+    TraceScope trace("traverse", path);
+    struct dirent *entry;
+    struct stat info;
+    DIR *dp = fdopendir(fd);
+    vector<DirEntry> entries;
+    string newPath;
+    unsigned char type;
+    dev_t entryDevice;
+    ino_t entryInode;
+    int childFd;
+    size_t i;
+
+    if (!dp) {
+        close(fd);
+        files.push_back(path);
+        return;
+    }
+
+    // readdir() order depends on the filesystem, so entries are visited by
+    // name to give every checkout of a tree the same file indexes
+    while ((entry = readdir(dp))) {
+        DirEntry current = {entry->d_name, entry->d_type, entry->d_ino};
+
+        if (current.name == "." || current.name == "..") {
             continue;
-        } else if (currentEntry[0] == '.' && !readHidden) {
-            entry = readdir(dp);
+        } else if (current.name[0] == '.' && !readHidden) {
             continue;
         }
+        entries.push_back(current);
+    }
+    sort(entries.begin(), entries.end(),
+         [](const DirEntry &a, const DirEntry &b) {
+             return a.name < b.name;
+         });
+
+    for (i = 0; i < entries.size(); i++) {
+        newPath = path + '/' + entries[i].name;
+        type = entries[i].type;
+        entryDevice = device;
+        entryInode = entries[i].inode;
+
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            if (fstatat(dirfd(dp), entries[i].name.c_str(), &info, 0) != 0) {
+                files.push_back(newPath);
+                continue;
+            }
+            type = S_ISDIR(info.st_mode) ? DT_DIR : DT_REG;
+            entryDevice = info.st_dev;
+            entryInode = info.st_ino;
+        }
 
-        newPath = path + '/' + currentEntry;
-        addFile(newPath, files, recursive, readHidden);
-        entry = readdir(dp);
+        if (type != DT_DIR) {
+            if (seen.insert(FileId(entryDevice, entryInode)).second) {
+                files.push_back(newPath);
+            }
+            continue;
+        }
+
+        childFd = openat(dirfd(dp), entries[i].name.c_str(),
+                         O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (childFd < 0) {
+            files.push_back(newPath);
+        } else if (fstat(childFd, &info) != 0 ||
+                   !seen.insert(FileId(info.st_dev, info.st_ino)).second) {
+            close(childFd);
+        } else {
+            addDirectory(childFd, info.st_dev, newPath, files, readHidden,
+                         seen);
+        }
     }
 
     closedir(dp);
 }
 
-void checkColumns(vector<string> files)
+// Adds every path in a NUL-separated list, such as the output of find -print0
+// or git ls-files -z. A list name of - reads the list from standard input.
+void addFileList(const string &listName, vector<string> &files,
+                 bool recursive, bool readHidden, set<FileId> &seen)
 {
-    unsigned i, j, lineNumber = 1;
-    string filename, checkLine;
-    ifstream infile;
-
-    for (i = 0; i < files.size(); i++) {
-        j = 0;
-        filename = files[i];
-        infile.open(filename.c_str());
-
-        if (!infile.is_open()) {
-            if (filename[0] != '*')
-                cerr << "Error opening file: " << filename << endl;
-            continue;
-        }
+    InputFile list;
+    string path;
 
-        while (!getline(infile, checkLine).eof()) {
-            if (checkLine.length() > 80) {
-                if (j < 4) {
-                    cout << filename << ":" << lineNumber 
-                         << " goes past 80 columns." << endl;
-                    j++;
-                } else {
-                    cout << "More than 4 lines go past 80 columns in \'" 
-                         << filename << "\'..." << endl;
-                    break;
-                }
-            }
-            lineNumber++;
+    if (listName == "-") {
+        list.open(STDIN_FILENO, listName);
+    } else {
+        list.open(listName);
+    }
+    if (!list.is_open()) {
+        cerr << "Error opening file: " << listName << endl;
+        return;
+    }
+
+    while (getline(list, path, '\0')) {
+        if (!path.empty()) {
+            addFile(path, files, recursive, readHidden, seen);
         }
-        infile.close();
     }
 }
 
-void checkTabs(vector<string> files)
+void checkColumns(string filename, InputFile &infile)
 {
-    unsigned i, j, lineNumber;
-    bool keepChecking;
-    string response, filename, checkLine;
-    ifstream infile;
-    stringstream ss;
+    TraceScope trace("checkColumns", filename);
+    unsigned j = 0, lineNumber = 1;
+    string checkLine;
 
-    for (i = 0; i < files.size(); i++) {
-        keepChecking = true;
-        filename = files[i];
-        infile.open(filename.c_str());
+    if (!infile.is_open()) {
+        if (filename[0] != '*')
+            cerr << "Error opening file: " << filename << endl;
+        return;
+    }
 
-        if (!infile.is_open()) {
-            cerr << "Error opening file \'" << filename << "\'" << endl;
-            continue;
+    while (!getline(infile, checkLine).eof()) {
+        if (checkLine.length() > 80) {
+            if (j < 4) {
+                cout << filename << ":" << lineNumber 
+                     << " goes past 80 columns." << endl;
+                j++;
+            } else {
+                cout << "More than 4 lines go past 80 columns in \'" 
+                     << filename << "\'..." << endl;
+                break;
+            }
         }
+        lineNumber++;
+    }
+}
 
-        lineNumber = 1;
-        while (keepChecking && !getline(infile, checkLine).eof()) {
-            for (j = 0; j < checkLine.length(); j++) {
-                if (checkLine[j] == '\t') {
-                    ss << "Tabs found in " << filename
-                       << ":" << lineNumber;
-                    wordWrap(ss, cerr, 0);
-                    ss << "Would you like to detab this file? ";
-                    wordWrap(ss, cerr, 0);
-                    cin >> response;
+void checkTabs(string filename, InputFile &infile)
+{
+    TraceScope trace("checkTabs", filename);
+    unsigned j, lineNumber = 1;
+    bool keepChecking = true;
+    string response, checkLine;
+    stringstream ss;
 
-                    if (toupper(response[0]) == 'Y') {
-                        detab(filename);
-                    } 
+    if (!infile.is_open()) {
+        cerr << "Error opening file \'" << filename << "\'" << endl;
+        return;
+    }
 
+    while (keepChecking && !getline(infile, checkLine).eof()) {
+        for (j = 0; j < checkLine.length(); j++) {
+            if (checkLine[j] == '\t') {
+                ss << "Tabs found in " << filename
+                   << ":" << lineNumber;
+                wordWrap(ss, cerr, 0);
+                // No prompt when there is no way to answer it
+                if (!cin) {
                     keepChecking = false;
                     break;
                 }
+                ss << "Would you like to detab this file? ";
+                wordWrap(ss, cerr, 0);
+                cin >> response;
+
+                if (toupper(response[0]) == 'Y') {
+                    detab(filename);
+                } 
+
+                keepChecking = false;
+                break;
             }
-            lineNumber++;
         }
-        infile.close();
+        lineNumber++;
     }
 }
 
 void detab(string filename)
 {
+    TraceScope trace("detab", filename);
     int numSpaces;
-    unsigned i, j;
-    vector<string> lines;
-    string checkLine, currentLine;
-    ifstream infile(filename.c_str());
-    ofstream outfile;
     stringstream ss;
 
-    ss << "How many spaces per tab? ";
+    ss << "How many spaces per tab stop? ";
     wordWrap(ss, cerr, 0);
     while (!(cin >> numSpaces) || (numSpaces < 1)) {
+        if (cin.eof()) {
+            return;
+        }
         cin.clear();
         cin.ignore(256,'\n');
         cerr << "Invalid Input. Enter a positive integer. ";
     }    
 
-    while (!getline(infile, checkLine).eof()) {
-        currentLine = "";
-
-        for (i = 0; i < checkLine.length(); i++) {
-            if (checkLine[i] == '\t') {
-                for (j = 0; j < (unsigned)numSpaces; j++) {
-                    currentLine += ' ';
-                }
-            } else {
-                currentLine += checkLine[i];
-            }
-        }
-
-        lines.push_back(currentLine);
-    }
-
-    outfile.open(filename.c_str());
-    for (unsigned i = 0; i < lines.size(); i++) {
-        outfile << lines[i] << endl;
+    if (!detabFile(filename, numSpaces)) {
+        cerr << "Error detabbing file: " << filename << ": " << strerror(errno)
+             << endl;
     }
-
-    infile.close();
-    outfile.close();
 }
-
-void checkBrackets(string filename)
-{
-    stack<char> s;
-    ifstream infile(filename.c_str());
-    stringstream ss;
-    char currentChar;
-    char topStack;
-    string currentLine;
-    int lineNumber = 1;
-    bool singleQuote = false;
-    bool doubleQuote = false;
-    bool commentBlock = false;
-    bool commentLine = false;
-
-    while (!getline(infile, currentLine).eof()) {
-        for (size_t i = 0; i < currentLine.length(); i++) {
-            currentChar = currentLine[i];
-            switch (currentChar) {
-                case '{': 
-                    if (!singleQuote && !doubleQuote && !commentBlock &&
-                        !commentLine) {
-                        s.push(currentChar);
-                    }
-                    break;
-                case '}':
-                    if (!singleQuote && !doubleQuote && !commentBlock &&
-                        !commentLine) {
-                        if (s.empty() || s.top() != '{') {
-                            ss << filename << ':' << lineNumber 
-                               << " Bracket mismatch \'" << currentChar 
-                               << "\'";
-                            wordWrap(ss, cerr, 0);
-                        } else {
-                            s.pop();
-                        }
-                    }
-                    break;
-                case '\\': 
-                    if (!commentBlock && !commentLine) {
-                        i++;
-                    }
-                    break;
-                case '/':
-                    if (i + 1 < currentLine.length()) {
-                        if (currentLine[i + 1] == '/') {
-                            commentLine = true;
-                        } else if (currentLine[i + 1] == '*') {
-                            commentBlock = true;
-                        }
-                    }
-                    break;
-                case '*':
-                    if (!singleQuote && !doubleQuote && 
-                        i + 1 < currentLine.length()) {
-                        if (currentLine[i + 1] == '/' && commentLine) {
-                            commentLine = false;
-                        } else if (currentLine[i + 1] == '/' && !commentLine) {
-                            ss << filename << ':' << lineNumber 
-                               << " Comment mismatch '*/'";
-                            wordWrap(ss, cerr, 0);
-                        } 
-                    }
-                    break;
-                case '\'':
-                    if (doubleQuote || commentBlock || commentLine) {
-                        break;
-                    } else if (singleQuote) {
-                        try {
-                            topStack = s.top();
-                            if (topStack != '\'') {
-                                throw runtime_error("Single quote mismatch");
-                            }
-                            s.pop();
-                            singleQuote = false;
-                        } catch (...) {
-                            ss << filename << ':' << lineNumber 
-                               << " Quotation mismatch \'" << currentChar 
-                               << "\'";
-                            wordWrap(ss, cerr, 0);
-                        }
-                    } else {
-                        s.push(currentChar);
-                        singleQuote = true;
-                    }
-                    break;
-                case '\"':
-                    if (singleQuote || commentBlock || commentLine) {
-                        break;
-                    } else if (doubleQuote) {
-                        try {
-                            topStack = s.top();
-                            if (topStack != '\"') {
-                                throw runtime_error("Double quote mismatch");
-                            }
-                            s.pop();
-                            doubleQuote = false;
-                        } catch (...) {
-                            ss << filename << ':' << lineNumber 
-                               << " Quotation mismatch \'" << currentChar 
-                               << "\'";
-                            wordWrap(ss, cerr, 0);
-                        }
-                    } else {
-                        s.push(currentChar);
-                        doubleQuote = true;
-                    }
-                    break;
-                case '[':
-                    if (!singleQuote && !doubleQuote && !commentBlock &&
-                        !commentLine) {
-                        s.push(currentChar);
-                    }
-                    break;
-                case ']':
-                    if (!singleQuote && !doubleQuote && !commentBlock && 
-                        !commentLine) {
-                        if (s.empty() || s.top() != '[') {
-                            ss << filename << ':' << lineNumber 
-                               << " Bracket mismatch \'" << currentChar 
-                               << "\'";
-                            wordWrap(ss, cerr, 0);
-                        } else {
-                            s.pop();
-                        }
-                    }
-                    break;
-                case '(':
-                    if (!singleQuote && !doubleQuote && !commentBlock &&
-                        !commentLine) {
-                        s.push(currentChar);
-                    }
-                    break;
-                case ')':
-                    if (!singleQuote && !doubleQuote && !commentBlock && 
-                        !commentLine) {
-                        if (s.empty() || s.top() != '(') {
-                            ss << filename << ':' << lineNumber 
-                               << " Bracket mismatch \'" << currentChar 
-                               << "\'";
-                            wordWrap(ss, cerr, 0);
-                        } else {
-                            s.pop();
-                        }
-                    }
-                    break;
-                default:
-                    break;
-            }
-        }
-        commentLine = false;
-        lineNumber++;
-    }
-        
-    infile.close();
-}
-
-
-
-
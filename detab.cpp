@@ -0,0 +1,176 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "detab.h"
+using namespace std;
+
+static const size_t OUTPUT_BUFFER = 1 << 20;
+
+static size_t expandTab(unsigned tabWidth, size_t &column, char *out);
+static bool writeAll(int fd, const char *data, size_t length);
+
+/*
+ * The SSE2 path copies 16 bytes at a time, looking for tabs and newlines in
+ * the same pass. Blocks without a tab are stored whole; otherwise only the
+ * bytes before the first tab are kept, which is why out needs 16 bytes of
+ * slack.
+ */
+size_t detabBlock(const char *in, size_t length, unsigned tabWidth,
+                  size_t &column, char *out)
+{
+    size_t i = 0, written = 0;
+
+#ifdef __SSE2__
+    const __m128i tabs = _mm_set1_epi8('\t');
+    const __m128i newlines = _mm_set1_epi8('\n');
+    __m128i block;
+    unsigned tabMask, lineMask, first;
+
+    while (i + 16 <= length) {
+        block = _mm_loadu_si128((const __m128i *)(in + i));
+        tabMask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, tabs));
+        lineMask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newlines));
+        _mm_storeu_si128((__m128i *)(out + written), block);
+
+        first = tabMask ? __builtin_ctz(tabMask) : 16;
+        lineMask &= (1u << first) - 1;
+        if (lineMask) {
+            column = first - 1 - (31 - __builtin_clz(lineMask));
+        } else {
+            column += first;
+        }
+        written += first;
+        i += first;
+
+        if (tabMask) {
+            written += expandTab(tabWidth, column, out + written);
+            i++;
+        }
+    }
+#endif
+
+    for (; i < length; i++) {
+        if (in[i] == '\t') {
+            written += expandTab(tabWidth, column, out + written);
+        } else {
+            out[written++] = in[i];
+            column = in[i] == '\n' ? 0 : column + 1;
+        }
+    }
+
+    return written;
+}
+
+/*
+ * Streams the file through detabBlock() in pieces small enough that one
+ * fixed output buffer always has room, into an unlinked temporary file. Only
+ * once that is complete is the original truncated and the result copied back
+ * into it, so that it keeps its inode, links, owner and permissions.
+ */
+bool detabFile(const string &filename, unsigned tabWidth)
+{
+    struct stat info;
+    const char *data = NULL;
+    size_t size, piece, offset, column = 0, length;
+    vector<char> out;
+    ssize_t copied;
+    FILE *temp;
+    bool ok = true;
+    int fd, tempFd, error;
+
+    if (tabWidth < 1) {
+        errno = EINVAL;
+        return false;
+    }
+
+    fd = open(filename.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &info) != 0) {
+        error = errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+    size = info.st_size;
+    if (size > 0) {
+        data = (const char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            error = errno;
+            close(fd);
+            errno = error;
+            return false;
+        }
+        madvise((void *)data, size, MADV_SEQUENTIAL);
+    }
+
+    temp = tmpfile();
+    tempFd = temp ? fileno(temp) : -1;
+    ok = temp != NULL;
+
+    piece = OUTPUT_BUFFER / tabWidth > 0 ? OUTPUT_BUFFER / tabWidth : 1;
+    out.resize(piece * tabWidth + 16);
+    for (offset = 0; ok && offset < size; offset += length) {
+        length = size - offset < piece ? size - offset : piece;
+        ok = writeAll(tempFd, out.data(),
+                      detabBlock(data + offset, length, tabWidth, column,
+                                 out.data()));
+    }
+    error = errno;
+    if (data) {
+        munmap((void *)data, size);
+    }
+
+    // Nothing has been changed until here
+    if (ok && (lseek(tempFd, 0, SEEK_SET) != 0 || ftruncate(fd, 0) != 0)) {
+        ok = false;
+        error = errno;
+    }
+    while (ok && (copied = read(tempFd, out.data(), out.size())) != 0) {
+        ok = copied > 0 && writeAll(fd, out.data(), copied);
+        error = errno;
+    }
+
+    if (temp) {
+        fclose(temp);
+    }
+    if (close(fd) != 0 && ok) {
+        ok = false;
+        error = errno;
+    }
+    errno = error;
+    return ok;
+}
+
+static size_t expandTab(unsigned tabWidth, size_t &column, char *out)
+{
+    size_t spaces = tabWidth - column % tabWidth;
+
+    memset(out, ' ', spaces);
+    column += spaces;
+    return spaces;
+}
+
+static bool writeAll(int fd, const char *data, size_t length)
+{
+    ssize_t written;
+
+    while (length > 0) {
+        written = write(fd, data, length);
+        if (written < 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
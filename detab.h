@@ -0,0 +1,18 @@
+#ifndef DETAB_H
+#define DETAB_H
+
+#include <string>
+
+// Expands the tabs in in[0, length) to spaces up to the next tab stop, every
+// tabWidth columns. column is the column the input starts at, and is updated
+// to the column it ends at. out needs room for length * tabWidth + 16 bytes.
+// Returns the number of bytes written.
+size_t detabBlock(const char *in, size_t length, unsigned tabWidth,
+                  size_t &column, char *out);
+
+// Rewrites a file in place with its tabs expanded. Returns false with errno
+// set on failure, which leaves the file untouched unless it happens while the
+// result is being copied back.
+bool detabFile(const std::string &filename, unsigned tabWidth);
+
+#endif
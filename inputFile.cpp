@@ -0,0 +1,369 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "inputFile.h"
+#include "trace.h"
+using namespace std;
+
+static const size_t BLOCK_SIZE = 256 * 1024;
+static const size_t NUM_BLOCKS = 4;
+// Size of the compressed reads made by the gzip decompressor
+static const size_t INPUT_SIZE = 64 * 1024;
+
+Compression detectCompression(const char *data, size_t length)
+{
+    const unsigned char *magic = (const unsigned char *)data;
+
+    if (length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        return GZIP_COMPRESSION;
+    } else if (length >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+               magic[2] == 0x2f && magic[3] == 0xfd) {
+        return ZSTD_COMPRESSION;
+    }
+    return NO_COMPRESSION;
+}
+
+DecompressBuf::DecompressBuf(DescriptorBuf *source, Compression compression,
+                             const string &name)
+    : source(source), compression(compression), name(name),
+      blocks(NUM_BLOCKS, vector<char>(BLOCK_SIZE)), lengths(NUM_BLOCKS),
+      filled(0), readBlock(0), writeBlock(0), holding(false),
+      finished(false), stopping(false), failed(false), problem(NULL)
+{
+    setg(NULL, NULL, NULL);
+    worker = thread(&DecompressBuf::decompress, this);
+}
+
+DecompressBuf::~DecompressBuf()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    worker.join();
+    delete source;
+}
+
+DecompressBuf::int_type DecompressBuf::underflow()
+{
+    unique_lock<mutex> guard(lock);
+
+    if (holding) {
+        holding = false;
+        readBlock = (readBlock + 1) % NUM_BLOCKS;
+        filled--;
+        changed.notify_all();
+    }
+    while (filled == 0 && !finished) {
+        changed.wait(guard);
+    }
+
+    if (filled == 0) {
+        if (failed) {
+            failed = false;
+            cerr << "Error decompressing file: " << name;
+            if (problem) {
+                cerr << ": " << problem;
+            }
+            cerr << endl;
+        }
+        setg(NULL, NULL, NULL);
+        return traits_type::eof();
+    }
+
+    holding = true;
+    char *block = blocks[readBlock].data();
+    setg(block, block, block + lengths[readBlock]);
+    return traits_type::to_int_type(*gptr());
+}
+
+void DecompressBuf::decompress()
+{
+    TraceScope trace("decompress", name);
+    bool ok;
+
+    if (compression == GZIP_COMPRESSION) {
+        ok = decompressGzip();
+    } else {
+        ok = decompressZstd();
+    }
+
+    lock_guard<mutex> guard(lock);
+    finished = true;
+    failed = !ok;
+    changed.notify_all();
+}
+
+bool DecompressBuf::decompressGzip()
+{
+    z_stream stream;
+    vector<char> in(INPUT_SIZE);
+    streamsize length;
+    char *block;
+    int status = Z_OK;
+    bool ended = false, ok = true;
+
+    memset(&stream, 0, sizeof(stream));
+    // Adding 16 to the window bits expects a gzip header and trailer
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return false;
+    }
+
+    while (!ended && (block = nextBlock())) {
+        stream.next_out = (Bytef *)block;
+        stream.avail_out = BLOCK_SIZE;
+
+        while (stream.avail_out > 0) {
+            if (stream.avail_in == 0) {
+                length = source->sgetn(in.data(), in.size());
+                if (length <= 0) {
+                    ended = true;
+                    break;
+                }
+                stream.next_in = (Bytef *)in.data();
+                stream.avail_in = length;
+            }
+            if (status == Z_STREAM_END) {
+                // Members may be concatenated; anything else after a member
+                // is ignored, as gzip does
+                if (stream.next_in[0] != 0x1f) {
+                    ended = true;
+                    break;
+                }
+                inflateReset(&stream);
+            }
+            status = inflate(&stream, Z_NO_FLUSH);
+            if (status != Z_OK && status != Z_STREAM_END) {
+                ok = false;
+                ended = true;
+                break;
+            }
+        }
+
+        if (stream.avail_out < BLOCK_SIZE) {
+            finishBlock(BLOCK_SIZE - stream.avail_out);
+        }
+    }
+
+    inflateEnd(&stream);
+    // Input that ends inside a member was truncated
+    return ok && status == Z_STREAM_END;
+}
+
+#ifdef HAVE_ZSTD
+bool DecompressBuf::decompressZstd()
+{
+    ZSTD_DStream *stream = ZSTD_createDStream();
+    vector<char> in(ZSTD_DStreamInSize());
+    ZSTD_inBuffer input = {in.data(), 0, 0};
+    ZSTD_outBuffer output;
+    size_t hint = 0;
+    streamsize length;
+    char *block;
+    bool eof = false, pending = false, ok = true;
+
+    ZSTD_initDStream(stream);
+    while (ok && (!eof || pending) && (block = nextBlock())) {
+        output.dst = block;
+        output.size = BLOCK_SIZE;
+        output.pos = 0;
+
+        while (output.pos < output.size) {
+            if (input.pos == input.size && !pending) {
+                length = source->sgetn(in.data(), in.size());
+                if (length <= 0) {
+                    eof = true;
+                    break;
+                }
+                input.size = length;
+                input.pos = 0;
+            }
+            hint = ZSTD_decompressStream(stream, &output, &input);
+            if (ZSTD_isError(hint)) {
+                ok = false;
+                break;
+            }
+            pending = output.pos == output.size;
+        }
+
+        if (output.pos > 0) {
+            finishBlock(output.pos);
+        }
+    }
+
+    ZSTD_freeDStream(stream);
+    // A frame still expecting input at end of file was truncated
+    return ok && (!eof || hint == 0);
+}
+#else
+bool DecompressBuf::decompressZstd()
+{
+    problem = "zstd support was not compiled in";
+    return false;
+}
+#endif
+
+char *DecompressBuf::nextBlock()
+{
+    unique_lock<mutex> guard(lock);
+
+    while (filled == NUM_BLOCKS && !stopping) {
+        changed.wait(guard);
+    }
+    if (stopping) {
+        return NULL;
+    }
+    return blocks[writeBlock].data();
+}
+
+void DecompressBuf::finishBlock(size_t length)
+{
+    lock_guard<mutex> guard(lock);
+
+    lengths[writeBlock] = length;
+    writeBlock = (writeBlock + 1) % NUM_BLOCKS;
+    filled++;
+    changed.notify_all();
+}
+
+DescriptorBuf::DescriptorBuf(int fd, const string &name, bool owned)
+    : fd(fd), name(name), owned(owned), reading(false)
+{
+    setg(buffer, buffer, buffer);
+}
+
+DescriptorBuf::~DescriptorBuf()
+{
+    if (reading) {
+        traceEnd("read");
+    }
+    if (owned) {
+        ::close(fd);
+    }
+}
+
+const char *DescriptorBuf::peek(size_t &length)
+{
+    while ((size_t)(egptr() - gptr()) < length && fill()) {
+    }
+    length = egptr() - gptr();
+    return gptr();
+}
+
+DescriptorBuf::int_type DescriptorBuf::underflow()
+{
+    if (gptr() == egptr() && !fill()) {
+        return traits_type::eof();
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+// Reads more after the bytes already buffered, first moving them to the
+// start of the buffer. Returns false at end of input or on an error.
+bool DescriptorBuf::fill()
+{
+    size_t unread = egptr() - gptr();
+    ssize_t length;
+
+    if (!reading) {
+        reading = true;
+        traceBegin("read", name);
+    }
+
+    memmove(buffer, gptr(), unread);
+    setg(buffer, buffer, buffer + unread);
+    do {
+        length = read(fd, egptr(), sizeof(buffer) - unread);
+    } while (length < 0 && errno == EINTR);
+
+    if (length <= 0) {
+        return false;
+    }
+    setg(buffer, buffer, egptr() + length);
+    return true;
+}
+
+InputFile::InputFile() : istream(NULL), decompress(NULL), descriptor(NULL)
+{
+}
+
+InputFile::InputFile(const string &filename)
+    : istream(NULL), decompress(NULL), descriptor(NULL)
+{
+    open(filename);
+}
+
+InputFile::~InputFile()
+{
+    close();
+}
+
+void InputFile::open(const string &filename)
+{
+    int fd;
+
+    close();
+    {
+        TraceScope trace("open", filename);
+        fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        setstate(failbit);
+        return;
+    }
+    attach(fd, filename, true);
+}
+
+void InputFile::open(int fd, const string &name)
+{
+    close();
+    if (fcntl(fd, F_GETFD) < 0) {
+        setstate(failbit);
+        return;
+    }
+    attach(fd, name, false);
+}
+
+// Peeks at the first bytes through the buffer that will read the rest, so
+// that compression is recognised on pipes as well as files
+void InputFile::attach(int fd, const string &name, bool owned)
+{
+    DescriptorBuf *source = new DescriptorBuf(fd, name, owned);
+    size_t length = 4;
+    const char *magic = source->peek(length);
+    Compression compression = detectCompression(magic, length);
+
+    if (compression != NO_COMPRESSION) {
+        decompress = new DecompressBuf(source, compression, name);
+        rdbuf(decompress);
+    } else {
+        descriptor = source;
+        rdbuf(descriptor);
+    }
+}
+
+bool InputFile::is_open() const
+{
+    return decompress || descriptor;
+}
+
+bool InputFile::compressed() const
+{
+    return decompress;
+}
+
+void InputFile::close()
+{
+    rdbuf(NULL);
+    delete decompress;
+    decompress = NULL;
+    delete descriptor;
+    descriptor = NULL;
+}
@@ -0,0 +1,105 @@
+#ifndef INPUT_FILE_H
+#define INPUT_FILE_H
+
+#include <condition_variable>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum Compression {
+    NO_COMPRESSION,
+    GZIP_COMPRESSION,
+    ZSTD_COMPRESSION
+};
+
+Compression detectCompression(const char *data, size_t length);
+
+// Reads straight from a file descriptor, closing it when done only if it is
+// owned; standard input is read this way as it may be a pipe or socket that
+// cannot be opened again by name. Reading is traced as one span, from the
+// first read until this is destroyed.
+class DescriptorBuf : public std::streambuf {
+public:
+    DescriptorBuf(int fd, const std::string &name, bool owned);
+    ~DescriptorBuf();
+
+    // Buffers at least length bytes unless the input ends first, and returns
+    // them without consuming them. length is set to the number available.
+    const char *peek(size_t &length);
+
+protected:
+    int_type underflow();
+
+private:
+    bool fill();
+
+    int fd;
+    std::string name;
+    bool owned;
+    bool reading;
+    char buffer[64 * 1024];
+};
+
+// Decompresses what source reads on its own thread into a small ring of
+// fixed-size blocks, which the reading side consumes as they fill up. Takes
+// ownership of source.
+class DecompressBuf : public std::streambuf {
+public:
+    DecompressBuf(DescriptorBuf *source, Compression compression,
+                  const std::string &name);
+    ~DecompressBuf();
+
+protected:
+    int_type underflow();
+
+private:
+    void decompress();
+    bool decompressGzip();
+    bool decompressZstd();
+    char *nextBlock();
+    void finishBlock(size_t length);
+
+    DescriptorBuf *source;
+    Compression compression;
+    std::string name;
+    std::vector<std::vector<char> > blocks;
+    std::vector<size_t> lengths;
+    size_t filled;
+    size_t readBlock;
+    size_t writeBlock;
+    bool holding;
+    bool finished;
+    bool stopping;
+    bool failed;
+    // Why decompression failed, if there is more to say than that it did
+    const char *problem;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread worker;
+};
+
+// Drop-in replacement for ifstream that transparently decompresses .gz and
+// .zst files, recognised by their magic bytes rather than their names.
+class InputFile : public std::istream {
+public:
+    InputFile();
+    InputFile(const std::string &filename);
+    ~InputFile();
+
+    void open(const std::string &filename);
+    // Reads from an open descriptor, which is left open when this closes
+    void open(int fd, const std::string &name);
+    bool is_open() const;
+    bool compressed() const;
+    void close();
+
+private:
+    void attach(int fd, const std::string &name, bool owned);
+
+    DecompressBuf *decompress;
+    DescriptorBuf *descriptor;
+};
+
+#endif
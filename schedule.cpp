@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include "schedule.h"
+using namespace std;
+
+struct DiskLocation {
+    dev_t device;
+    bool mapped;
+    unsigned long long position;
+    size_t index;
+};
+
+static bool firstExtent(const string &path, unsigned long long &physical);
+static bool locationOrder(const DiskLocation &a, const DiskLocation &b);
+static void advise(const string &path, int advice);
+
+bool parseSchedule(const string &name, ScheduleOrder &schedule)
+{
+    if (name == "readdir") {
+        schedule = TRAVERSAL_ORDER;
+    } else if (name == "inode") {
+        schedule = INODE_ORDER;
+    } else if (name == "extent") {
+        schedule = EXTENT_ORDER;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *scheduleName(ScheduleOrder schedule)
+{
+    switch (schedule) {
+        case INODE_ORDER:
+            return "inode";
+        case EXTENT_ORDER:
+            return "extent";
+        default:
+            return "readdir";
+    }
+}
+
+void scheduleFiles(const vector<string> &paths, vector<size_t> &order,
+                   ScheduleOrder schedule)
+{
+    vector<DiskLocation> locations(order.size());
+    struct stat info;
+
+    if (schedule == TRAVERSAL_ORDER) {
+        return;
+    }
+
+    for (size_t i = 0; i < order.size(); i++) {
+        DiskLocation &location = locations[i];
+        const string &path = paths[order[i]];
+
+        location.index = order[i];
+        location.device = 0;
+        location.mapped = false;
+        location.position = 0;
+        if (stat(path.c_str(), &info) != 0) {
+            continue;
+        }
+        location.device = info.st_dev;
+        location.position = info.st_ino;
+        if (schedule == EXTENT_ORDER &&
+            firstExtent(path, location.position)) {
+            location.mapped = true;
+        }
+    }
+
+    stable_sort(locations.begin(), locations.end(), locationOrder);
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = locations[i].index;
+    }
+}
+
+Prefetcher::Prefetcher(const vector<string> &paths,
+                       const vector<size_t> &order, size_t window)
+    : paths(paths), order(order), window(window), next(0)
+{
+}
+
+void Prefetcher::restart()
+{
+    next = 0;
+}
+
+void Prefetcher::advance(size_t position)
+{
+    if (window == 0) {
+        return;
+    }
+    while (next < order.size() && next <= position + window) {
+        advise(paths[order[next]], POSIX_FADV_WILLNEED);
+        next++;
+    }
+}
+
+bool dropCaches(const vector<string> &paths)
+{
+    ofstream control;
+
+    sync();
+    control.open("/proc/sys/vm/drop_caches");
+    if (control << "3" << flush) {
+        return true;
+    }
+
+    for (size_t i = 0; i < paths.size(); i++) {
+        advise(paths[i], POSIX_FADV_DONTNEED);
+    }
+    return false;
+}
+
+static bool firstExtent(const string &path, unsigned long long &physical)
+{
+    unsigned long long buffer[(sizeof(struct fiemap) +
+                               sizeof(struct fiemap_extent)) /
+                              sizeof(unsigned long long) + 1];
+    struct fiemap *map = (struct fiemap *)buffer;
+    bool found;
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    memset(buffer, 0, sizeof(buffer));
+    map->fm_start = 0;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+    found = ioctl(fd, FS_IOC_FIEMAP, map) == 0 && map->fm_mapped_extents > 0;
+    if (found) {
+        physical = map->fm_extents[0].fe_physical;
+    }
+
+    close(fd);
+    return found;
+}
+
+// Mapped files come first on each device, by physical address, followed by
+// the rest by inode number
+static bool locationOrder(const DiskLocation &a, const DiskLocation &b)
+{
+    if (a.device != b.device) {
+        return a.device < b.device;
+    } else if (a.mapped != b.mapped) {
+        return a.mapped;
+    }
+    return a.position < b.position;
+}
+
+static void advise(const string &path, int advice)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+    if (fd >= 0) {
+        posix_fadvise(fd, 0, 0, advice);
+        close(fd);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <string>
+#include <vector>
+
+enum ScheduleOrder {
+    TRAVERSAL_ORDER,
+    INODE_ORDER,
+    EXTENT_ORDER
+};
+
+bool parseSchedule(const std::string &name, ScheduleOrder &schedule);
+const char *scheduleName(ScheduleOrder schedule);
+
+// Reorders indices into paths so that files are read in the order they lie
+// on disk: by the physical address of their first extent where FIEMAP is
+// supported, otherwise by inode number.
+void scheduleFiles(const std::vector<std::string> &paths,
+                   std::vector<size_t> &order, ScheduleOrder schedule);
+
+// Asks the kernel to start reading the next few files of a schedule while
+// the current one is being checked.
+class Prefetcher {
+public:
+    Prefetcher(const std::vector<std::string> &paths,
+               const std::vector<size_t> &order, size_t window);
+
+    void restart();
+    void advance(size_t position);
+
+private:
+    const std::vector<std::string> &paths;
+    const std::vector<size_t> &order;
+    size_t window;
+    size_t next;
+};
+
+// Empties the page cache so the next run starts cold. Without permission
+// to drop the whole cache, the given files are evicted one at a time.
+// Returns false if that fallback had to be used.
+bool dropCaches(const std::vector<std::string> &paths);
+
+#endif
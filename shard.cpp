@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <queue>
+#include <cstdlib>
+#include <sys/stat.h>
+#include "shard.h"
+using namespace std;
+
+static const char REPORT_MAGIC[] = "check-shard-report 1";
+
+struct ShardRecord {
+    int phase;
+    size_t fileIndex;
+    int stream;
+    string text;
+};
+
+static bool readReport(const string &filename, vector<ShardRecord> &records);
+static bool recordOrder(const ShardRecord &a, const ShardRecord &b);
+
+bool parseShard(const string &spec, unsigned &index, unsigned &count)
+{
+    char *end;
+    unsigned long i, n;
+
+    i = strtoul(spec.c_str(), &end, 10);
+    if (end == spec.c_str() || *end != '/') {
+        return false;
+    }
+    n = strtoul(end + 1, &end, 10);
+    if (*end != '\0' || n == 0 || i >= n) {
+        return false;
+    }
+
+    index = i;
+    count = n;
+    return true;
+}
+
+/*
+ * Largest files first, each to the shard with the least data so far (ties go
+ * to the lowest shard). Equal sizes are taken in path order, so that the
+ * assignment does not depend on the order the paths were found in.
+ */
+vector<unsigned> assignShards(const vector<string> &paths, unsigned count)
+{
+    vector<pair<long long, size_t> > bySize;
+    vector<unsigned> shards(paths.size());
+    priority_queue<pair<long long, unsigned>,
+                   vector<pair<long long, unsigned> >,
+                   greater<pair<long long, unsigned> > > loads;
+    struct stat info;
+    size_t i;
+
+    for (i = 0; i < paths.size(); i++) {
+        long long size = stat(paths[i].c_str(), &info) == 0 ? info.st_size : 0;
+        bySize.push_back(make_pair(-size, i));
+    }
+    sort(bySize.begin(), bySize.end(),
+         [&paths](const pair<long long, size_t> &a,
+                  const pair<long long, size_t> &b) {
+             return a.first < b.first ||
+                    (a.first == b.first && paths[a.second] < paths[b.second]);
+         });
+
+    for (unsigned s = 0; s < count; s++) {
+        loads.push(make_pair(0LL, s));
+    }
+    for (i = 0; i < bySize.size(); i++) {
+        pair<long long, unsigned> lightest = loads.top();
+        loads.pop();
+        shards[bySize[i].second] = lightest.second;
+        lightest.first -= bySize[i].first;
+        loads.push(lightest);
+    }
+
+    return shards;
+}
+
+ShardCapture::ShardCapture(bool enabled)
+    : enabled(enabled), active(false), outBuf(1, *this), errBuf(2, *this),
+      realOut(NULL), realErr(NULL)
+{
+    if (enabled) {
+        cout << REPORT_MAGIC << endl;
+    }
+}
+
+ShardCapture::~ShardCapture()
+{
+    restore();
+}
+
+void ShardCapture::begin()
+{
+    if (!enabled || active) {
+        return;
+    }
+    active = true;
+    realOut = cout.rdbuf(&outBuf);
+    realErr = cerr.rdbuf(&errBuf);
+}
+
+void ShardCapture::end(ReportPhase phase, size_t fileIndex)
+{
+    if (!active) {
+        return;
+    }
+    restore();
+
+    for (size_t i = 0; i < chunks.size(); i++) {
+        cout << phase << ' ' << fileIndex << ' ' << chunks[i].first << ' '
+             << chunks[i].second.size() << '\n';
+        cout.write(chunks[i].second.data(), chunks[i].second.size());
+    }
+    cout.flush();
+    chunks.clear();
+}
+
+void ShardCapture::discard()
+{
+    restore();
+    chunks.clear();
+}
+
+void ShardCapture::append(int stream, const char *s, size_t n)
+{
+    if (chunks.empty() || chunks.back().first != stream) {
+        chunks.push_back(make_pair(stream, string()));
+    }
+    chunks.back().second.append(s, n);
+}
+
+void ShardCapture::restore()
+{
+    if (!active) {
+        return;
+    }
+    active = false;
+    cout.rdbuf(realOut);
+    cerr.rdbuf(realErr);
+}
+
+ShardCapture::CaptureBuf::CaptureBuf(int stream, ShardCapture &capture)
+    : stream(stream), capture(capture)
+{
+}
+
+ShardCapture::CaptureBuf::int_type
+ShardCapture::CaptureBuf::overflow(int_type c)
+{
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        char ch = traits_type::to_char_type(c);
+        capture.append(stream, &ch, 1);
+    }
+    return traits_type::not_eof(c);
+}
+
+streamsize ShardCapture::CaptureBuf::xsputn(const char *s, streamsize n)
+{
+    capture.append(stream, s, n);
+    return n;
+}
+
+int mergeReports(const vector<string> &reports)
+{
+    vector<ShardRecord> records;
+
+    for (size_t i = 0; i < reports.size(); i++) {
+        if (!readReport(reports[i], records)) {
+            return 1;
+        }
+    }
+
+    stable_sort(records.begin(), records.end(), recordOrder);
+    for (size_t i = 0; i < records.size(); i++) {
+        ostream &os = records[i].stream == 2 ? cerr : cout;
+        os.write(records[i].text.data(), records[i].text.size());
+        os.flush();
+    }
+    return 0;
+}
+
+static bool readReport(const string &filename, vector<ShardRecord> &records)
+{
+    ifstream infile(filename.c_str(), ios::binary);
+    string header;
+    ShardRecord record;
+    size_t length;
+
+    if (!infile.is_open()) {
+        cerr << "Error opening file: " << filename << endl;
+        return false;
+    }
+    if (!getline(infile, header) || header != REPORT_MAGIC) {
+        cerr << filename << ": not a shard report" << endl;
+        return false;
+    }
+
+    while (infile >> record.phase >> record.fileIndex >> record.stream
+                  >> length) {
+        infile.get();
+        record.text.resize(length);
+        if (!infile.read(&record.text[0], length)) {
+            cerr << filename << ": truncated shard report" << endl;
+            return false;
+        }
+        records.push_back(record);
+    }
+
+    if (!infile.eof()) {
+        cerr << filename << ": corrupt shard report" << endl;
+        return false;
+    }
+    return true;
+}
+
+static bool recordOrder(const ShardRecord &a, const ShardRecord &b)
+{
+    return a.phase < b.phase ||
+           (a.phase == b.phase && a.fileIndex < b.fileIndex);
+}
@@ -0,0 +1,69 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Output is grouped by phase in this order in an unsharded run
+enum ReportPhase {
+    TRAVERSAL_PHASE,
+    TABS_PHASE,
+    COLUMNS_PHASE,
+    BRACKETS_PHASE,
+    ARCHIVE_PHASE
+};
+
+bool parseShard(const std::string &spec, unsigned &index, unsigned &count);
+
+// Returns the shard of every path, balancing the total file size of each
+// shard. The result only depends on the set of paths and their sizes, so
+// every process checking the same tree agrees on it.
+std::vector<unsigned> assignShards(const std::vector<std::string> &paths,
+                                   unsigned count);
+
+// While sharding, holds back everything written to cout and cerr for one
+// unit of work and then writes it to stdout as records keyed by phase and
+// file index. When not sharding, begin() and end() do nothing.
+class ShardCapture {
+public:
+    ShardCapture(bool enabled);
+    ~ShardCapture();
+
+    void begin();
+    void end(ReportPhase phase, size_t fileIndex);
+    void discard();
+
+private:
+    class CaptureBuf : public std::streambuf {
+    public:
+        CaptureBuf(int stream, ShardCapture &capture);
+
+    protected:
+        int_type overflow(int_type c);
+        std::streamsize xsputn(const char *s, std::streamsize n);
+
+    private:
+        int stream;
+        ShardCapture &capture;
+    };
+
+    void append(int stream, const char *s, size_t n);
+    void restore();
+
+    bool enabled;
+    bool active;
+    std::vector<std::pair<int, std::string> > chunks;
+    CaptureBuf outBuf;
+    CaptureBuf errBuf;
+    std::streambuf *realOut;
+    std::streambuf *realErr;
+};
+
+// Prints the records of several shard reports in the order an unsharded run
+// would have printed them. Returns the exit status.
+int mergeReports(const std::vector<std::string> &reports);
+
+#endif
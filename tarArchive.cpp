@@ -0,0 +1,224 @@
+#include <iostream>
+#include <cstring>
+#include "inputFile.h"
+#include "tarArchive.h"
+#include "trace.h"
+using namespace std;
+
+static const size_t TAR_BLOCK = 512;
+static const size_t MEMBER_BUFFER = 64 * 1024;
+
+// Long names and pax records are read whole, so their size is capped
+static const size_t MAX_EXTENDED_HEADER = 1024 * 1024;
+
+// Presents the data of one archive member as a stream of its own
+class MemberBuf : public streambuf {
+public:
+    MemberBuf(istream &archive, unsigned long long size)
+        : archive(archive), remaining(size)
+    {
+        setg(buffer, buffer, buffer);
+    }
+
+    unsigned long long unread() const
+    {
+        return remaining;
+    }
+
+protected:
+    int_type underflow()
+    {
+        size_t length = MEMBER_BUFFER;
+
+        if (remaining < length) {
+            length = remaining;
+        }
+        if (length == 0 || !archive.read(buffer, length)) {
+            return traits_type::eof();
+        }
+        remaining -= length;
+        setg(buffer, buffer, buffer + length);
+        return traits_type::to_int_type(*gptr());
+    }
+
+private:
+    istream &archive;
+    unsigned long long remaining;
+    char buffer[MEMBER_BUFFER];
+};
+
+static bool validHeader(const char *header);
+static unsigned long long parseNumber(const char *field, size_t length);
+static string headerName(const char *header);
+static string paxPath(const string &records);
+static bool skipData(istream &archive, unsigned long long size);
+static unsigned long long padding(unsigned long long size);
+
+bool isTarArchive(const string &path)
+{
+    const char *suffixes[] = {".tar", ".tar.gz", ".tgz", ".tar.zst", ".tzst"};
+    size_t length;
+
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(*suffixes); i++) {
+        length = strlen(suffixes[i]);
+        if (path.size() > length &&
+            path.compare(path.size() - length, length, suffixes[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void checkTarArchive(const string &path, const StreamChecks &checks)
+{
+    TraceScope trace("checkTarArchive", path);
+    InputFile archive(path);
+    char header[TAR_BLOCK];
+    unsigned long long size;
+    string longName, name, records;
+    char type;
+
+    if (!archive.is_open()) {
+        cerr << "Error opening file: " << path << endl;
+        return;
+    }
+
+    while (archive.read(header, TAR_BLOCK)) {
+        if (header[0] == '\0') {
+            return;
+        }
+        if (!validHeader(header)) {
+            cerr << path << ": not a tar archive" << endl;
+            return;
+        }
+
+        type = header[156];
+        size = parseNumber(header + 124, 12);
+
+        if ((type == 'L' || type == 'x') && size > MAX_EXTENDED_HEADER) {
+            cerr << path << ": skipping extended header of " << size
+                 << " bytes" << endl;
+            if (!skipData(archive, size + padding(size))) {
+                cerr << path << ": unexpected end of archive" << endl;
+                return;
+            }
+            continue;
+        } else if (type == 'L' || type == 'x') {
+            // GNU long name or pax extended header for the next member
+            records.resize(size);
+            if (!archive.read(&records[0], size) ||
+                !skipData(archive, padding(size))) {
+                cerr << path << ": unexpected end of archive" << endl;
+                return;
+            }
+            if (type == 'L') {
+                longName = records.c_str();
+            } else if (paxPath(records) != "") {
+                longName = paxPath(records);
+            }
+            continue;
+        }
+
+        name = longName != "" ? longName : headerName(header);
+        longName = "";
+
+        if (type == '0' || type == '\0' || type == '7') {
+            MemberBuf member(archive, size);
+            istream in(&member);
+
+            checkStream(path + ":" + name, in, checks);
+            if (!skipData(archive, member.unread() + padding(size))) {
+                cerr << path << ": unexpected end of archive" << endl;
+                return;
+            }
+        } else if (!skipData(archive, size + padding(size))) {
+            cerr << path << ": unexpected end of archive" << endl;
+            return;
+        }
+    }
+
+    if (archive.gcount() != 0) {
+        cerr << path << ": unexpected end of archive" << endl;
+    }
+}
+
+static bool validHeader(const char *header)
+{
+    const unsigned char *bytes = (const unsigned char *)header;
+    unsigned long long sum = 0;
+
+    for (size_t i = 0; i < TAR_BLOCK; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : bytes[i];
+    }
+    return sum == parseNumber(header + 148, 8);
+}
+
+// Numeric fields are octal, or big-endian binary when the top bit is set
+static unsigned long long parseNumber(const char *field, size_t length)
+{
+    const unsigned char *bytes = (const unsigned char *)field;
+    unsigned long long value = 0;
+    size_t i = 0;
+
+    if (bytes[0] & 0x80) {
+        value = bytes[0] & 0x7f;
+        for (i = 1; i < length; i++) {
+            value = (value << 8) | bytes[i];
+        }
+        return value;
+    }
+
+    while (i < length && (field[i] == ' ' || field[i] == '\0')) {
+        i++;
+    }
+    while (i < length && field[i] >= '0' && field[i] <= '7') {
+        value = value * 8 + (field[i] - '0');
+        i++;
+    }
+    return value;
+}
+
+static string headerName(const char *header)
+{
+    string name(header, strnlen(header, 100));
+    string prefix;
+
+    if (memcmp(header + 257, "ustar", 5) == 0) {
+        prefix.assign(header + 345, strnlen(header + 345, 155));
+    }
+    return prefix != "" ? prefix + "/" + name : name;
+}
+
+// pax records look like "<length> <key>=<value>\n"
+static string paxPath(const string &records)
+{
+    size_t start = 0, space, equals;
+    unsigned long length;
+
+    while (start < records.size()) {
+        length = strtoul(records.c_str() + start, NULL, 10);
+        space = records.find(' ', start);
+        if (length == 0 || space == string::npos ||
+            start + length > records.size()) {
+            break;
+        }
+        equals = records.find('=', space);
+        if (equals < start + length &&
+            records.compare(space + 1, equals - space - 1, "path") == 0) {
+            return records.substr(equals + 1, start + length - equals - 2);
+        }
+        start += length;
+    }
+    return "";
+}
+
+static bool skipData(istream &archive, unsigned long long size)
+{
+    archive.ignore(size);
+    return (unsigned long long)archive.gcount() == size;
+}
+
+static unsigned long long padding(unsigned long long size)
+{
+    return (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+}
@@ -0,0 +1,13 @@
+#ifndef TAR_ARCHIVE_H
+#define TAR_ARCHIVE_H
+
+#include <string>
+#include "checkStream.h"
+
+bool isTarArchive(const std::string &path);
+
+// Streams through the archive once, checking each regular member as if it
+// were a file named archive:member. Archives may be gzip or zstd compressed.
+void checkTarArchive(const std::string &path, const StreamChecks &checks);
+
+#endif
@@ -0,0 +1,239 @@
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+#include "trace.h"
+using namespace std;
+
+static const size_t RING_SIZE = 1 << 16;
+
+struct TraceEvent {
+    long long time;
+    const char *name;
+    char phase;
+    string detail;
+};
+
+struct TraceRing {
+    int thread;
+    size_t written;
+    vector<TraceEvent> events;
+};
+
+// Hands a thread's ring back when the thread exits, so that short-lived
+// workers reuse rings (and trace thread ids) instead of piling them up
+struct RingOwner {
+    TraceRing *ring;
+    ~RingOwner();
+};
+
+static bool tracing = false;
+static chrono::steady_clock::time_point traceStart;
+static mutex ringsLock;
+static vector<TraceRing *> rings;
+static vector<TraceRing *> freeRings;
+static thread_local RingOwner owner = {NULL};
+
+static void record(const char *name, char phase, const string *detail);
+static void writeEscaped(ostream &os, const string &text);
+static size_t utf8Length(const string &text, size_t start);
+
+void startTrace()
+{
+    traceStart = chrono::steady_clock::now();
+    tracing = true;
+}
+
+bool writeTrace(const string &filename)
+{
+    ofstream outfile(filename.c_str());
+    lock_guard<mutex> guard(ringsLock);
+    bool first = true;
+    size_t i, j, depth;
+
+    if (!outfile.is_open()) {
+        return false;
+    }
+
+    // Timestamps are in microseconds
+    outfile << fixed << setprecision(3) << "{\"traceEvents\":[";
+    for (i = 0; i < rings.size(); i++) {
+        const TraceRing &current = *rings[i];
+
+        outfile << (first ? "\n" : ",\n")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                << "\"tid\":" << current.thread << ",\"args\":{\"name\":\""
+                << (current.thread == 1 ? "main" : "worker") << "\"}}";
+        first = false;
+
+        // Once the ring has wrapped, the oldest end events may have lost
+        // their begin events; they are dropped to keep the spans balanced
+        j = current.written > RING_SIZE ? current.written - RING_SIZE : 0;
+        for (depth = 0; j < current.written; j++) {
+            const TraceEvent &event = current.events[j % RING_SIZE];
+
+            if (event.phase == 'B') {
+                depth++;
+            } else if (depth == 0) {
+                continue;
+            } else {
+                depth--;
+            }
+            outfile << ",\n{\"name\":\"" << event.name << "\",\"ph\":\""
+                    << event.phase << "\",\"ts\":" << event.time / 1000.0
+                    << ",\"pid\":1,\"tid\":" << current.thread;
+            if (event.phase == 'B' && !event.detail.empty()) {
+                outfile << ",\"args\":{\"path\":\"";
+                writeEscaped(outfile, event.detail);
+                outfile << "\"}";
+            }
+            outfile << "}";
+        }
+    }
+    outfile << "\n]}\n";
+
+    return outfile.good();
+}
+
+void traceBegin(const char *name, const string &detail)
+{
+    if (tracing) {
+        record(name, 'B', &detail);
+    }
+}
+
+void traceEnd(const char *name)
+{
+    if (tracing) {
+        record(name, 'E', NULL);
+    }
+}
+
+TraceScope::TraceScope(const char *name) : name(name), active(tracing)
+{
+    if (active) {
+        record(name, 'B', NULL);
+    }
+}
+
+TraceScope::TraceScope(const char *name, const string &detail)
+    : name(name), active(tracing)
+{
+    if (active) {
+        record(name, 'B', &detail);
+    }
+}
+
+TraceScope::~TraceScope()
+{
+    if (active) {
+        record(name, 'E', NULL);
+    }
+}
+
+RingOwner::~RingOwner()
+{
+    if (ring) {
+        lock_guard<mutex> guard(ringsLock);
+        freeRings.push_back(ring);
+    }
+}
+
+static void record(const char *name, char phase, const string *detail)
+{
+    TraceRing *ring = owner.ring;
+
+    if (!ring) {
+        lock_guard<mutex> guard(ringsLock);
+        if (!freeRings.empty()) {
+            ring = freeRings.back();
+            freeRings.pop_back();
+        } else {
+            ring = new TraceRing;
+            ring->thread = rings.size() + 1;
+            ring->written = 0;
+            rings.push_back(ring);
+        }
+        owner.ring = ring;
+    }
+
+    if (ring->events.size() < RING_SIZE) {
+        ring->events.push_back(TraceEvent());
+    }
+    TraceEvent &event = ring->events[ring->written % RING_SIZE];
+    event.time = chrono::duration_cast<chrono::nanoseconds>(
+                     chrono::steady_clock::now() - traceStart).count();
+    event.name = name;
+    event.phase = phase;
+    if (detail) {
+        event.detail = *detail;
+    } else {
+        event.detail.clear();
+    }
+    ring->written++;
+}
+
+// Paths are bytes, but JSON must be UTF-8, so bytes that are not part of a
+// valid UTF-8 sequence are replaced with U+FFFD
+static void writeEscaped(ostream &os, const string &text)
+{
+    const char *hex = "0123456789abcdef";
+    size_t length;
+
+    for (size_t i = 0; i < text.size(); i += length) {
+        unsigned char c = text[i];
+        length = 1;
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (c < 0x20) {
+            os << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+        } else if (c < 0x80) {
+            os << c;
+        } else if ((length = utf8Length(text, i)) > 0) {
+            os.write(text.data() + i, length);
+        } else {
+            os << "\\ufffd";
+            length = 1;
+        }
+    }
+}
+
+// Returns the length of the UTF-8 sequence starting at text[start], or 0 if
+// it is not valid (including overlong forms and surrogates)
+static size_t utf8Length(const string &text, size_t start)
+{
+    unsigned char c = text[start];
+    unsigned long code;
+    size_t length, i;
+
+    if (c >= 0xc2 && c <= 0xdf) {
+        length = 2;
+        code = c & 0x1f;
+    } else if (c >= 0xe0 && c <= 0xef) {
+        length = 3;
+        code = c & 0x0f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        length = 4;
+        code = c & 0x07;
+    } else {
+        return 0;
+    }
+    if (start + length > text.size()) {
+        return 0;
+    }
+
+    for (i = 1; i < length; i++) {
+        c = text[start + i];
+        if ((c & 0xc0) != 0x80) {
+            return 0;
+        }
+        code = (code << 6) | (c & 0x3f);
+    }
+
+    if ((length == 3 && (code < 0x800 || (code >= 0xd800 && code <= 0xdfff)))
+        || (length == 4 && (code < 0x10000 || code > 0x10ffff))) {
+        return 0;
+    }
+    return length;
+}
@@ -0,0 +1,32 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <string>
+
+void startTrace();
+
+// Writes every recorded event in Chrome trace-event format. Must only be
+// called once all other threads have finished.
+bool writeTrace(const std::string &filename);
+
+// Record the begin and end of a span that cannot be tied to one scope. The
+// spans must still nest with the scopes and other spans of the thread.
+void traceBegin(const char *name, const std::string &detail);
+void traceEnd(const char *name);
+
+// Records a begin event when created and the matching end event when it goes
+// out of scope. Does nothing unless startTrace() has been called. Events go
+// to a ring buffer owned by the calling thread, so recording takes no locks;
+// when a ring fills up, its oldest events are overwritten.
+class TraceScope {
+public:
+    TraceScope(const char *name);
+    TraceScope(const char *name, const std::string &detail);
+    ~TraceScope();
+
+private:
+    const char *name;
+    bool active;
+};
+
+#endif
@@ -35,6 +35,7 @@ void wordWrap(stringstream &ss, ostream &os, int indentation)
 int screenWidth()
 {
     struct winsize w;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != 0 || w.ws_col == 0)
+        return 80;
     return w.ws_col;
 }
\ No newline at end of file